@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cmath>
+
+/**
+ * Dual number v + d*e (e*e = 0) for forward-mode automatic differentiation.
+ * Evaluating a function on duals whose d parts hold the derivatives of the inputs
+ * with respect to a parameter yields the exact derivative of the result in its d
+ * part. The comparisons look at the values only, so branches follow the same path
+ * as with plain scalars.
+ */
+template<typename T>
+class Dual {
+public:
+	T v;
+	T d;
+
+public:
+	Dual(T v = T(0), T d = T(0)) : v(v), d(d) {}
+
+	Dual& operator+=(const Dual& b) { v += b.v; d += b.d; return *this; }
+	Dual& operator-=(const Dual& b) { v -= b.v; d -= b.d; return *this; }
+	Dual& operator*=(const Dual& b) { d = d * b.v + v * b.d; v *= b.v; return *this; }
+	Dual& operator/=(const Dual& b) { d = (d * b.v - v * b.d) / (b.v * b.v); v /= b.v; return *this; }
+
+	friend Dual operator+(Dual a, const Dual& b) { return a += b; }
+	friend Dual operator-(Dual a, const Dual& b) { return a -= b; }
+	friend Dual operator*(Dual a, const Dual& b) { return a *= b; }
+	friend Dual operator/(Dual a, const Dual& b) { return a /= b; }
+	friend Dual operator-(const Dual& a) { return Dual(-a.v, -a.d); }
+
+	friend bool operator==(const Dual& a, const Dual& b) { return a.v == b.v; }
+	friend bool operator!=(const Dual& a, const Dual& b) { return a.v != b.v; }
+	friend bool operator<(const Dual& a, const Dual& b) { return a.v < b.v; }
+	friend bool operator<=(const Dual& a, const Dual& b) { return a.v <= b.v; }
+	friend bool operator>(const Dual& a, const Dual& b) { return a.v > b.v; }
+	friend bool operator>=(const Dual& a, const Dual& b) { return a.v >= b.v; }
+
+	friend Dual sqrt(const Dual& a) {
+		T s = std::sqrt(a.v);
+		return Dual(s, s > 0 ? a.d / (2 * s) : T(0));
+	}
+	friend Dual abs(const Dual& a) { return a.v < 0 ? -a : a; }
+	friend Dual cos(const Dual& a) { return Dual(std::cos(a.v), -std::sin(a.v) * a.d); }
+	friend Dual sin(const Dual& a) { return Dual(std::sin(a.v), std::cos(a.v) * a.d); }
+	friend Dual atan2(const Dual& y, const Dual& x) {
+		T r2 = x.v * x.v + y.v * y.v;
+		return Dual(std::atan2(y.v, x.v), r2 > 0 ? (x.v * y.d - y.v * x.d) / r2 : T(0));
+	}
+};
+
+/**
+ * Value of a scalar that may be a dual number.
+ */
+template<typename T>
+inline T value(const T& a) { return a; }
+
+template<typename T>
+inline T value(const Dual<T>& a) { return a.v; }
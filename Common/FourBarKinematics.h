@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Geometry.h"
+
+/**
+ * Forward kinematics of the four-bar linkage of FourBarLinkage, shared by the
+ * editor and the batch evaluation so that both follow the same branch.
+ */
+namespace fourbar {
+	/**
+	 * Place the points of the linkage at the crank angle theta: the two ground
+	 * points (0 and 1), the end of the crank of length lengths[0] around point 0
+	 * (2), the joint of the coupler and the rocker (3), and the end effector (4).
+	 * Of the two solutions of each dyad, the one closer to the position predicted
+	 * from the previous positions and their last motion is taken, or the CCW one if
+	 * there is no motion yet. The points buffer is reused, so that solving does not
+	 * allocate. Returns false if the linkage cannot be assembled at this angle.
+	 */
+	inline bool forwardKinematics(const glm::dvec2& ground1, const glm::dvec2& ground2, const std::vector<double>& lengths, double theta, const std::vector<glm::dvec2>& prev_points, const std::vector<glm::dvec2>& flows, std::vector<glm::dvec2>& points) {
+		points.resize(5);
+		points[0] = ground1;
+		points[1] = ground2;
+		points[2] = points[0] + glm::dvec2(cos(theta), sin(theta)) * lengths[0];
+
+		if (prev_points.size() == 5 && flows.size() == 5) {
+			return geometry::circleCircleIntersection(points[2], lengths[2], points[1], lengths[1], prev_points[3] + flows[3], points[3])
+				&& geometry::circleCircleIntersection(points[2], lengths[3], points[3], lengths[4], prev_points[4] + flows[4], points[4]);
+		}
+		else {
+			return geometry::circleCircleIntersection(points[2], lengths[2], points[1], lengths[1], geometry::CCW, points[3])
+				&& geometry::circleCircleIntersection(points[2], lengths[3], points[3], lengths[4], geometry::CCW, points[4]);
+		}
+	}
+}
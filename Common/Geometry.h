@@ -0,0 +1,212 @@
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define GEOMETRY_USE_AVX
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GEOMETRY_USE_SSE2
+#endif
+
+/**
+ * Circle-circle intersection (dyad solve) shared by all the solvers.
+ *
+ * Of the two intersections, side CCW returns the one on the left of the vector
+ * from center1 to center2 when the y axis points up (on the right in screen
+ * coordinates), and side CW returns the other one. None of the functions throws;
+ * a dyad that cannot be assembled is reported by the return value.
+ */
+namespace geometry {
+	enum { CW = -1, CCW = 1 };
+
+	template<typename T>
+	inline bool circleCircleIntersection(T x1, T y1, T radius1, T x2, T y2, T radius2, int side, T& x, T& y) {
+		// unqualified, so that scalar types such as dual numbers can provide their own
+		using std::sqrt;
+		using std::abs;
+
+		T dx = x2 - x1;
+		T dy = y2 - y1;
+		T d2 = dx * dx + dy * dy;
+		T d = sqrt(d2);
+		if (!(d <= radius1 + radius2) || d < abs(radius1 - radius2) || d2 == T(0)) return false;
+
+		T a = (radius1 * radius1 - radius2 * radius2 + d2) / d / T(2);
+		T h = sqrt(std::max(radius1 * radius1 - a * a, T(0)));
+
+		x = x1 + dx * a / d - dy / d * h * T(side);
+		y = y1 + dy * a / d + dx / d * h * T(side);
+		return true;
+	}
+
+	template<typename T, glm::precision P>
+	inline bool circleCircleIntersection(const glm::tvec2<T, P>& center1, T radius1, const glm::tvec2<T, P>& center2, T radius2, int side, glm::tvec2<T, P>& result) {
+		return circleCircleIntersection(center1.x, center1.y, radius1, center2.x, center2.y, radius2, side, result.x, result.y);
+	}
+
+	/**
+	 * Return the intersection that is closer to the expected position.
+	 */
+	template<typename T, glm::precision P>
+	inline bool circleCircleIntersection(const glm::tvec2<T, P>& center1, T radius1, const glm::tvec2<T, P>& center2, T radius2, const glm::tvec2<T, P>& expected_pos, glm::tvec2<T, P>& result) {
+		glm::tvec2<T, P> pt1, pt2;
+		if (!circleCircleIntersection(center1, radius1, center2, radius2, CCW, pt1)) return false;
+		circleCircleIntersection(center1, radius1, center2, radius2, CW, pt2);
+
+		result = glm::length(pt1 - expected_pos) < glm::length(pt2 - expected_pos) ? pt1 : pt2;
+		return true;
+	}
+
+	/**
+	 * Batched versions. Each call solves 4 (or 8) independent dyads given as arrays of
+	 * centers, radii and sides (+1/-1 as a float), and returns a mask whose bit i is
+	 * set when dyad i has no intersection. The outputs of the failed dyads are undefined.
+	 */
+	inline unsigned circleCircleIntersection4(const float* x1, const float* y1, const float* radius1, const float* x2, const float* y2, const float* radius2, const float* side, float* x, float* y) {
+#ifdef GEOMETRY_USE_SSE2
+		__m128 cx1 = _mm_loadu_ps(x1);
+		__m128 cy1 = _mm_loadu_ps(y1);
+		__m128 r1 = _mm_loadu_ps(radius1);
+		__m128 r2 = _mm_loadu_ps(radius2);
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(x2), cx1);
+		__m128 dy = _mm_sub_ps(_mm_loadu_ps(y2), cy1);
+		__m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+		__m128 d = _mm_sqrt_ps(d2);
+
+		__m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		__m128 fail = _mm_cmpnle_ps(d, _mm_add_ps(r1, r2));
+		fail = _mm_or_ps(fail, _mm_cmplt_ps(d, _mm_and_ps(_mm_sub_ps(r1, r2), abs_mask)));
+		fail = _mm_or_ps(fail, _mm_cmpeq_ps(d2, _mm_setzero_ps()));
+
+		__m128 inv_d = _mm_div_ps(_mm_set1_ps(1.0f), d);
+		__m128 r1_2 = _mm_mul_ps(r1, r1);
+		__m128 a = _mm_mul_ps(_mm_mul_ps(_mm_add_ps(_mm_sub_ps(r1_2, _mm_mul_ps(r2, r2)), d2), inv_d), _mm_set1_ps(0.5f));
+		__m128 h = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(r1_2, _mm_mul_ps(a, a)), _mm_setzero_ps()));
+		__m128 u = _mm_mul_ps(a, inv_d);
+		__m128 v = _mm_mul_ps(_mm_mul_ps(h, inv_d), _mm_loadu_ps(side));
+
+		_mm_storeu_ps(x, _mm_sub_ps(_mm_add_ps(cx1, _mm_mul_ps(dx, u)), _mm_mul_ps(dy, v)));
+		_mm_storeu_ps(y, _mm_add_ps(_mm_add_ps(cy1, _mm_mul_ps(dy, u)), _mm_mul_ps(dx, v)));
+		return _mm_movemask_ps(fail);
+#else
+		unsigned fail = 0;
+		for (int i = 0; i < 4; ++i) {
+			if (!circleCircleIntersection(x1[i], y1[i], radius1[i], x2[i], y2[i], radius2[i], side[i] < 0 ? CW : CCW, x[i], y[i])) fail |= 1 << i;
+		}
+		return fail;
+#endif
+	}
+
+	inline unsigned circleCircleIntersection8(const float* x1, const float* y1, const float* radius1, const float* x2, const float* y2, const float* radius2, const float* side, float* x, float* y) {
+#ifdef GEOMETRY_USE_AVX
+		__m256 cx1 = _mm256_loadu_ps(x1);
+		__m256 cy1 = _mm256_loadu_ps(y1);
+		__m256 r1 = _mm256_loadu_ps(radius1);
+		__m256 r2 = _mm256_loadu_ps(radius2);
+		__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x2), cx1);
+		__m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y2), cy1);
+		__m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+		__m256 d = _mm256_sqrt_ps(d2);
+
+		__m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+		__m256 fail = _mm256_cmp_ps(d, _mm256_add_ps(r1, r2), _CMP_NLE_UQ);
+		fail = _mm256_or_ps(fail, _mm256_cmp_ps(d, _mm256_and_ps(_mm256_sub_ps(r1, r2), abs_mask), _CMP_LT_OQ));
+		fail = _mm256_or_ps(fail, _mm256_cmp_ps(d2, _mm256_setzero_ps(), _CMP_EQ_OQ));
+
+		__m256 inv_d = _mm256_div_ps(_mm256_set1_ps(1.0f), d);
+		__m256 r1_2 = _mm256_mul_ps(r1, r1);
+		__m256 a = _mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_sub_ps(r1_2, _mm256_mul_ps(r2, r2)), d2), inv_d), _mm256_set1_ps(0.5f));
+		__m256 h = _mm256_sqrt_ps(_mm256_max_ps(_mm256_sub_ps(r1_2, _mm256_mul_ps(a, a)), _mm256_setzero_ps()));
+		__m256 u = _mm256_mul_ps(a, inv_d);
+		__m256 v = _mm256_mul_ps(_mm256_mul_ps(h, inv_d), _mm256_loadu_ps(side));
+
+		_mm256_storeu_ps(x, _mm256_sub_ps(_mm256_add_ps(cx1, _mm256_mul_ps(dx, u)), _mm256_mul_ps(dy, v)));
+		_mm256_storeu_ps(y, _mm256_add_ps(_mm256_add_ps(cy1, _mm256_mul_ps(dy, u)), _mm256_mul_ps(dx, v)));
+		return _mm256_movemask_ps(fail);
+#else
+		unsigned fail = circleCircleIntersection4(x1, y1, radius1, x2, y2, radius2, side, x, y);
+		fail |= circleCircleIntersection4(x1 + 4, y1 + 4, radius1 + 4, x2 + 4, y2 + 4, radius2 + 4, side + 4, x + 4, y + 4) << 4;
+		return fail;
+#endif
+	}
+
+	inline unsigned circleCircleIntersection4(const double* x1, const double* y1, const double* radius1, const double* x2, const double* y2, const double* radius2, const double* side, double* x, double* y) {
+#ifdef GEOMETRY_USE_AVX
+		__m256d cx1 = _mm256_loadu_pd(x1);
+		__m256d cy1 = _mm256_loadu_pd(y1);
+		__m256d r1 = _mm256_loadu_pd(radius1);
+		__m256d r2 = _mm256_loadu_pd(radius2);
+		__m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x2), cx1);
+		__m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y2), cy1);
+		__m256d d2 = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+		__m256d d = _mm256_sqrt_pd(d2);
+
+		__m256d abs_mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+		__m256d fail = _mm256_cmp_pd(d, _mm256_add_pd(r1, r2), _CMP_NLE_UQ);
+		fail = _mm256_or_pd(fail, _mm256_cmp_pd(d, _mm256_and_pd(_mm256_sub_pd(r1, r2), abs_mask), _CMP_LT_OQ));
+		fail = _mm256_or_pd(fail, _mm256_cmp_pd(d2, _mm256_setzero_pd(), _CMP_EQ_OQ));
+
+		__m256d inv_d = _mm256_div_pd(_mm256_set1_pd(1.0), d);
+		__m256d r1_2 = _mm256_mul_pd(r1, r1);
+		__m256d a = _mm256_mul_pd(_mm256_mul_pd(_mm256_add_pd(_mm256_sub_pd(r1_2, _mm256_mul_pd(r2, r2)), d2), inv_d), _mm256_set1_pd(0.5));
+		__m256d h = _mm256_sqrt_pd(_mm256_max_pd(_mm256_sub_pd(r1_2, _mm256_mul_pd(a, a)), _mm256_setzero_pd()));
+		__m256d u = _mm256_mul_pd(a, inv_d);
+		__m256d v = _mm256_mul_pd(_mm256_mul_pd(h, inv_d), _mm256_loadu_pd(side));
+
+		_mm256_storeu_pd(x, _mm256_sub_pd(_mm256_add_pd(cx1, _mm256_mul_pd(dx, u)), _mm256_mul_pd(dy, v)));
+		_mm256_storeu_pd(y, _mm256_add_pd(_mm256_add_pd(cy1, _mm256_mul_pd(dy, u)), _mm256_mul_pd(dx, v)));
+		return _mm256_movemask_pd(fail);
+#else
+		unsigned fail = 0;
+		for (int i = 0; i < 4; ++i) {
+			if (!circleCircleIntersection(x1[i], y1[i], radius1[i], x2[i], y2[i], radius2[i], side[i] < 0 ? CW : CCW, x[i], y[i])) fail |= 1 << i;
+		}
+		return fail;
+#endif
+	}
+
+	/**
+	 * Solve n dyads in chunks of the widest available batch. failed[i] is set to 1 for
+	 * each dyad that has no intersection, and the number of such dyads is returned.
+	 */
+	inline int circleCircleIntersectionBatch(int n, const float* x1, const float* y1, const float* radius1, const float* x2, const float* y2, const float* radius2, const float* side, float* x, float* y, unsigned char* failed) {
+		int num_failed = 0;
+		int i = 0;
+		for (; i + 8 <= n; i += 8) {
+			unsigned mask = circleCircleIntersection8(x1 + i, y1 + i, radius1 + i, x2 + i, y2 + i, radius2 + i, side + i, x + i, y + i);
+			for (int k = 0; k < 8; ++k) {
+				failed[i + k] = (mask >> k) & 1;
+				num_failed += failed[i + k];
+			}
+		}
+		for (; i < n; ++i) {
+			failed[i] = circleCircleIntersection(x1[i], y1[i], radius1[i], x2[i], y2[i], radius2[i], side[i] < 0 ? CW : CCW, x[i], y[i]) ? 0 : 1;
+			num_failed += failed[i];
+		}
+
+		return num_failed;
+	}
+
+	inline int circleCircleIntersectionBatch(int n, const double* x1, const double* y1, const double* radius1, const double* x2, const double* y2, const double* radius2, const double* side, double* x, double* y, unsigned char* failed) {
+		int num_failed = 0;
+		int i = 0;
+		for (; i + 4 <= n; i += 4) {
+			unsigned mask = circleCircleIntersection4(x1 + i, y1 + i, radius1 + i, x2 + i, y2 + i, radius2 + i, side + i, x + i, y + i);
+			for (int k = 0; k < 4; ++k) {
+				failed[i + k] = (mask >> k) & 1;
+				num_failed += failed[i + k];
+			}
+		}
+		for (; i < n; ++i) {
+			failed[i] = circleCircleIntersection(x1[i], y1[i], radius1[i], x2[i], y2[i], radius2[i], side[i] < 0 ? CW : CCW, x[i], y[i]) ? 0 : 1;
+			num_failed += failed[i];
+		}
+
+		return num_failed;
+	}
+}
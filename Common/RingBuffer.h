@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+/**
+ * A fixed-capacity FIFO that keeps the last N elements pushed.
+ * Each element is stored twice, N elements apart, so that the current contents
+ * are always contiguous from data() to data() + size() (oldest first), and a push
+ * costs two writes regardless of the capacity.
+ */
+template<typename T>
+class RingBuffer {
+private:
+	std::vector<T> buffer;
+	int head;
+	int count;
+	int cap;
+
+public:
+	RingBuffer(int capacity = 0) : head(0), count(0), cap(0) {
+		setCapacity(capacity);
+	}
+
+	/**
+	 * Change the capacity. The contents are cleared.
+	 */
+	void setCapacity(int capacity) {
+		cap = capacity > 0 ? capacity : 0;
+		buffer.assign(cap * 2, T());
+		head = 0;
+		count = 0;
+	}
+
+	int capacity() const { return cap; }
+	int size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	void clear() {
+		head = 0;
+		count = 0;
+	}
+
+	/**
+	 * Append an element, dropping the oldest one if the buffer is full.
+	 */
+	void push_back(const T& value) {
+		if (cap == 0) return;
+
+		int tail = head + count;
+		if (tail >= cap) tail -= cap;
+		buffer[tail] = value;
+		buffer[tail + cap] = value;
+
+		if (count < cap) {
+			count++;
+		}
+		else {
+			head++;
+			if (head == cap) head = 0;
+		}
+	}
+
+	const T* data() const { return buffer.empty() ? NULL : &buffer[head]; }
+	const T* begin() const { return data(); }
+	const T* end() const { return data() + count; }
+
+	const T& operator[](int index) const { return buffer[head + index]; }
+	const T& front() const { return buffer[head]; }
+	const T& back() const { return buffer[head + count - 1]; }
+};
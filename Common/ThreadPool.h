@@ -0,0 +1,144 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <boost/shared_ptr.hpp>
+
+/**
+ * A small work-stealing thread pool.
+ * Each worker owns a queue of tasks. A worker runs the tasks from the back of its
+ * own queue, and when it runs out, it steals from the front of the other queues,
+ * so that a few long tasks do not leave the other workers idle.
+ * The tasks must not throw.
+ */
+class ThreadPool {
+private:
+	class TaskQueue {
+	public:
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	std::vector<boost::shared_ptr<TaskQueue>> queues;
+	std::vector<std::thread> threads;
+
+	std::mutex mutex;
+	std::condition_variable task_available;
+	std::condition_variable all_done;
+	int num_queued;
+	int num_pending;
+	int next_queue;
+	bool stopping;
+
+public:
+	/**
+	 * Create a pool of the given number of threads (the number of hardware threads if 0).
+	 */
+	ThreadPool(int num_threads = 0) : num_queued(0), num_pending(0), next_queue(0), stopping(false) {
+		if (num_threads <= 0) num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+
+		for (int i = 0; i < num_threads; ++i) {
+			queues.push_back(boost::shared_ptr<TaskQueue>(new TaskQueue()));
+		}
+		for (int i = 0; i < num_threads; ++i) {
+			threads.push_back(std::thread(&ThreadPool::run, this, i));
+		}
+	}
+
+	~ThreadPool() {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		task_available.notify_all();
+		for (int i = 0; i < threads.size(); ++i) {
+			threads[i].join();
+		}
+	}
+
+	int size() const {
+		return threads.size();
+	}
+
+	/**
+	 * Add a task. The tasks are distributed over the workers in a round-robin fashion.
+	 */
+	void submit(const std::function<void()>& task) {
+		// the task is counted before it can be popped, so that the counters never go negative
+		int index;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			index = next_queue;
+			next_queue = (next_queue + 1) % queues.size();
+			num_queued++;
+			num_pending++;
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(queues[index]->mutex);
+			queues[index]->tasks.push_back(task);
+		}
+		task_available.notify_one();
+	}
+
+	/**
+	 * Block until all the submitted tasks have finished.
+	 */
+	void wait() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (num_pending > 0) all_done.wait(lock);
+	}
+
+private:
+	bool pop(int index, std::function<void()>& task) {
+		// own queue first, LIFO
+		{
+			std::unique_lock<std::mutex> lock(queues[index]->mutex);
+			if (!queues[index]->tasks.empty()) {
+				task = queues[index]->tasks.back();
+				queues[index]->tasks.pop_back();
+				return true;
+			}
+		}
+
+		// steal from the others, FIFO
+		for (int k = 1; k < queues.size(); ++k) {
+			TaskQueue& queue = *queues[(index + k) % queues.size()];
+			std::unique_lock<std::mutex> lock(queue.mutex);
+			if (!queue.tasks.empty()) {
+				task = queue.tasks.front();
+				queue.tasks.pop_front();
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void run(int index) {
+		while (true) {
+			std::function<void()> task;
+			if (pop(index, task)) {
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					num_queued--;
+				}
+
+				task();
+
+				std::unique_lock<std::mutex> lock(mutex);
+				if (--num_pending == 0) all_done.notify_all();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!stopping && num_queued == 0) task_available.wait(lock);
+			if (stopping && num_queued == 0) return;
+		}
+	}
+};
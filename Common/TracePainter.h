@@ -0,0 +1,86 @@
+#pragma once
+
+#include <QPainter>
+#include <QPolygonF>
+#include <cmath>
+#include <vector>
+#include "RingBuffer.h"
+
+/**
+ * Draw traces as polylines. Points closer than min_distance pixels to the last kept
+ * point are merged, so that a long trace costs about as many segments as it spans
+ * pixels. The polyline buffer and the pens of the fading bands are kept between
+ * calls to avoid reallocating them on every paint.
+ */
+class TracePainter {
+public:
+	// screen-space length below which the segments are merged
+	float min_distance;
+
+	// number of batches for the fading-age coloring, or 0 for a uniform color
+	int fade_bands;
+
+private:
+	QPolygonF polyline;
+	QPen band_source_pen;
+	std::vector<QPen> band_pens;
+
+public:
+	TracePainter() : min_distance(1.0f), fade_bands(0) {}
+
+	/**
+	 * Draw the trace from the oldest point to the newest one. With fading enabled,
+	 * the trace is split into fade_bands polylines whose opacity increases with
+	 * their recency.
+	 */
+	template<typename T>
+	void draw(QPainter& painter, const RingBuffer<T>& trace, const QPen& pen) {
+		if (trace.size() < 2) return;
+
+		// merge in screen space, whatever the world transform is
+		double scale = sqrt(fabs(painter.worldTransform().determinant()));
+		double min_dist = scale > 0 ? min_distance / scale : 0;
+
+		polyline.resize(0);
+		const T* p = trace.begin();
+		polyline.append(QPointF(p[0].x, p[0].y));
+		for (int i = 1; i < trace.size() - 1; ++i) {
+			const QPointF& last = polyline.last();
+			double dx = p[i].x - last.x();
+			double dy = p[i].y - last.y();
+			if (dx * dx + dy * dy >= min_dist * min_dist) {
+				polyline.append(QPointF(p[i].x, p[i].y));
+			}
+		}
+		polyline.append(QPointF(p[trace.size() - 1].x, p[trace.size() - 1].y));
+
+		if (fade_bands <= 1) {
+			painter.setPen(pen);
+			painter.drawPolyline(polyline.constData(), polyline.size());
+			return;
+		}
+
+		// the pens are made again only when the pen or the number of bands changes
+		if (band_pens.size() != fade_bands || band_source_pen != pen) {
+			band_source_pen = pen;
+			band_pens.assign(fade_bands, pen);
+			QColor color = pen.color();
+			for (int b = 0; b < fade_bands; ++b) {
+				QColor band_color(color);
+				band_color.setAlphaF(color.alphaF() * (b + 1) / fade_bands);
+				band_pens[b].setColor(band_color);
+			}
+		}
+
+		// consecutive bands share their end points so that the trace stays connected
+		int n = polyline.size();
+		for (int b = 0; b < fade_bands; ++b) {
+			int first = (n - 1) * b / fade_bands;
+			int last = (n - 1) * (b + 1) / fade_bands;
+			if (last <= first) continue;
+
+			painter.setPen(band_pens[b]);
+			painter.drawPolyline(polyline.constData() + first, last - first + 1);
+		}
+	}
+};
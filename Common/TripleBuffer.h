@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+
+/**
+ * Lock-free single-producer single-consumer triple buffer.
+ * The writer fills writeBuffer() and publishes it, the reader picks up the latest
+ * published buffer with update() and reads it through readBuffer(). The two never
+ * touch the same buffer, and neither ever waits for the other; the intermediate
+ * buffers that the reader did not pick up in time are simply overwritten.
+ */
+template<typename T>
+class TripleBuffer {
+private:
+	enum { INDEX_MASK = 3, FRESH = 4 };
+
+	T buffers[3];
+
+	// index of the buffer between the writer and the reader, with FRESH set if it has not been read yet
+	std::atomic<int> middle;
+	int back;
+	int front;
+
+public:
+	TripleBuffer() : middle(1), back(0), front(2) {}
+
+	/**
+	 * The buffer to fill. Only the writer thread may call this.
+	 */
+	T& writeBuffer() { return buffers[back]; }
+
+	/**
+	 * Publish the filled buffer. Only the writer thread may call this.
+	 */
+	void publish() {
+		back = middle.exchange(back | FRESH) & INDEX_MASK;
+	}
+
+	/**
+	 * Take the latest published buffer if there is a new one, and return whether
+	 * there was. Only the reader thread may call this.
+	 */
+	bool update() {
+		if (!(middle.load() & FRESH)) return false;
+		front = middle.exchange(front) & INDEX_MASK;
+		return true;
+	}
+
+	/**
+	 * The buffer taken by the last update(). Only the reader thread may call this.
+	 */
+	const T& readBuffer() const { return buffers[front]; }
+};
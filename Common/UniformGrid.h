@@ -0,0 +1,179 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <cmath>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+/**
+ * Uniform grid over the axis-aligned bounding boxes of items identified by
+ * non-negative integer ids. Each item is registered in every cell its box
+ * overlaps. Moving an item within the same range of cells only updates its box,
+ * so refreshing the grid after small motions does not touch the cells.
+ */
+class UniformGrid {
+private:
+	enum { MAX_CELL_COORD = 1 << 16 };
+
+	class Entry {
+	public:
+		glm::vec2 min;
+		glm::vec2 max;
+		int x0, y0, x1, y1;
+		bool valid;
+
+	public:
+		Entry() : x0(0), y0(0), x1(-1), y1(-1), valid(false) {}
+	};
+
+	float cell_size;
+	std::unordered_map<long long, std::vector<int>> cells;
+	std::vector<Entry> entries;
+
+	// items visited by the current query are marked with its stamp, so that the
+	// items spanning several cells are reported once
+	mutable std::vector<unsigned int> visited;
+	mutable unsigned int stamp;
+	mutable std::vector<int> candidates;
+
+public:
+	UniformGrid(float cell_size = 64) : cell_size(cell_size), stamp(0) {}
+
+	void clear() {
+		cells.clear();
+		entries.clear();
+		visited.clear();
+		stamp = 0;
+	}
+
+	int size() const { return entries.size(); }
+	bool contains(int id) const { return id < entries.size() && entries[id].valid; }
+	glm::vec2 boxMin(int id) const { return entries[id].min; }
+	glm::vec2 boxMax(int id) const { return entries[id].max; }
+
+	/**
+	 * Insert an item, or move it if it is already registered.
+	 */
+	void update(int id, const glm::vec2& min, const glm::vec2& max) {
+		if (id >= entries.size()) {
+			entries.resize(id + 1);
+			visited.resize(id + 1, 0);
+		}
+
+		Entry& entry = entries[id];
+		int x0 = cellCoord(min.x);
+		int y0 = cellCoord(min.y);
+		int x1 = cellCoord(max.x);
+		int y1 = cellCoord(max.y);
+		entry.min = min;
+		entry.max = max;
+		if (entry.valid && x0 == entry.x0 && y0 == entry.y0 && x1 == entry.x1 && y1 == entry.y1) return;
+
+		if (entry.valid) unlink(id);
+		entry.x0 = x0;
+		entry.y0 = y0;
+		entry.x1 = x1;
+		entry.y1 = y1;
+		entry.valid = true;
+		for (int y = y0; y <= y1; ++y) {
+			for (int x = x0; x <= x1; ++x) {
+				cells[key(x, y)].push_back(id);
+			}
+		}
+	}
+
+	void remove(int id) {
+		if (!contains(id)) return;
+
+		unlink(id);
+		entries[id].valid = false;
+	}
+
+	/**
+	 * Return the ids of the items whose boxes overlap the rectangle.
+	 */
+	void query(const glm::vec2& min, const glm::vec2& max, std::vector<int>& ids) const {
+		ids.clear();
+		newStamp();
+
+		int x0 = cellCoord(min.x);
+		int y0 = cellCoord(min.y);
+		int x1 = cellCoord(max.x);
+		int y1 = cellCoord(max.y);
+		for (int y = y0; y <= y1; ++y) {
+			for (int x = x0; x <= x1; ++x) {
+				std::unordered_map<long long, std::vector<int>>::const_iterator it = cells.find(key(x, y));
+				if (it == cells.end()) continue;
+
+				for (int k = 0; k < it->second.size(); ++k) {
+					int id = it->second[k];
+					if (visited[id] == stamp) continue;
+					visited[id] = stamp;
+
+					const Entry& entry = entries[id];
+					if (entry.max.x < min.x || entry.min.x > max.x || entry.max.y < min.y || entry.min.y > max.y) continue;
+					ids.push_back(id);
+				}
+			}
+		}
+	}
+
+	/**
+	 * Return the id of the item nearest to the point within max_dist, or -1 if
+	 * there is none. distance(id) returns the exact distance to an item, and is
+	 * called only for the items whose boxes are within max_dist. Ties are broken
+	 * by the smaller id.
+	 */
+	template<typename Distance>
+	int nearest(const glm::vec2& pt, float max_dist, Distance distance) const {
+		query(pt - glm::vec2(max_dist, max_dist), pt + glm::vec2(max_dist, max_dist), candidates);
+
+		int best = -1;
+		float best_dist = max_dist;
+		for (int i = 0; i < candidates.size(); ++i) {
+			float dist = distance(candidates[i]);
+			if (dist < best_dist || (dist == best_dist && (best < 0 || candidates[i] < best))) {
+				best = candidates[i];
+				best_dist = dist;
+			}
+		}
+
+		return best;
+	}
+
+private:
+	// coordinates far outside the design (or NaN) are clamped to the border cells,
+	// which is safe since the boxes are checked exactly
+	int cellCoord(float v) const {
+		float c = std::floor(v / cell_size);
+		if (!(c >= -MAX_CELL_COORD)) return -MAX_CELL_COORD;
+		if (c > MAX_CELL_COORD) return MAX_CELL_COORD;
+		return (int)c;
+	}
+
+	static long long key(int x, int y) {
+		return ((long long)x << 32) | (unsigned int)y;
+	}
+
+	void unlink(int id) {
+		const Entry& entry = entries[id];
+		for (int y = entry.y0; y <= entry.y1; ++y) {
+			for (int x = entry.x0; x <= entry.x1; ++x) {
+				std::vector<int>& cell = cells[key(x, y)];
+				std::vector<int>::iterator it = std::find(cell.begin(), cell.end(), id);
+				if (it != cell.end()) {
+					*it = cell.back();
+					cell.pop_back();
+				}
+			}
+		}
+	}
+
+	void newStamp() const {
+		if (++stamp == 0) {
+			std::fill(visited.begin(), visited.end(), 0);
+			stamp = 1;
+		}
+	}
+};
@@ -1,11 +1,13 @@
 #include "Canvas.h"
+#include "FourBarKinematics.h"
 #include <QPainter>
 #include <iostream>
 #include <QFileInfoList>
 #include <QDir>
 #include <QMessageBox>
 #include <QTextStream>
-#include <QDomDocument>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
 #include <QResizeEvent>
 #include <QtWidgets/QApplication>
 #include <QDate>
@@ -16,50 +18,7 @@ double crossProduct(const glm::dvec2& vec1, const glm::dvec2& vec2) {
 	return vec1.x * vec2.y - vec1.y * vec2.x;
 }
 
-glm::dvec2 circleCircleIntersection(const glm::dvec2& center1, double radius1, const glm::dvec2& center2, double radius2) {
-	glm::dvec2 dir = center2 - center1;
-	double d = glm::length(dir);
-	if (d > radius1 + radius2 || d < abs(radius1 - radius2)) {
-		throw "No intersection";
-	}
-
-	double a = (radius1 * radius1 - radius2 * radius2 + d * d) / d / 2.0;
-	double h = sqrtf(radius1 * radius1 - a * a);
-
-	glm::dvec2 perp(-dir.y, dir.x);
-	perp /= glm::length(perp);
-
-	return center1 + dir * a / d + perp * h;
-}
-
-glm::dvec2 circleCircleIntersection(const glm::dvec2& center1, double radius1, const glm::dvec2& center2, double radius2, const glm::dvec2& expected_pos) {
-	glm::dvec2 dir = center2 - center1;
-	double d = glm::length(dir);
-	if (d > radius1 + radius2 || d < abs(radius1 - radius2)) {
-		throw "No intersection";
-	}
-
-	double a = (radius1 * radius1 - radius2 * radius2 + d * d) / d / 2.0;
-	double h = 0;
-	if (radius1 * radius1 > a * a) {
-		h = sqrtf(radius1 * radius1 - a * a);
-	}
-
-	glm::dvec2 perp(-dir.y, dir.x);
-	perp /= glm::length(perp);
-
-	glm::dvec2 pt1 = center1 + dir * a / d + perp * h;
-	glm::dvec2 pt2 = center1 + dir * a / d - perp * h;
-
-	if (glm::length(pt1 - expected_pos) < glm::length(pt2 - expected_pos)) {
-		return pt1;
-	}
-	else {
-		return pt2;
-	}
-}
-
-Canvas::Canvas(QWidget *parent) : QWidget(parent) {
+Canvas::Canvas(QWidget *parent) : QWidget(parent), trace(400) {
 	ctrlPressed = false;
 	shiftPressed = false;
 
@@ -83,30 +42,22 @@ Canvas::Canvas(QWidget *parent) : QWidget(parent) {
 Canvas::~Canvas() {
 }
 
-void Canvas::forwardKinematics() {
-	if (ground_points.size() == 0) return;
+/**
+ * Update the positions of the points. Returns false if the linkage cannot be
+ * assembled at the current angle. The previous positions are kept in prev_points,
+ * and both buffers are reused, so that stepping does not allocate.
+ */
+bool Canvas::forwardKinematics() {
+	if (ground_points.size() < 2 || lengths.size() < 5) return true;
 
-	std::vector<glm::dvec2> prev_points = points;
+	prev_points.assign(points.begin(), points.end());
 
-	// calcualte the position of all the points
-	points = ground_points;
-	points.push_back(points[0] + glm::dvec2(cos(theta), sin(theta)) * lengths[0]);
-
-	if (point_flows.size() == 5) {
-		points.push_back(circleCircleIntersection(points[2], lengths[2], points[1], lengths[1], prev_points[3] + point_flows[3]));
-		points.push_back(circleCircleIntersection(points[2], lengths[3], points[3], lengths[4], prev_points[4] + point_flows[4]));
-	}
-	else {
-		points.push_back(circleCircleIntersection(points[2], lengths[2], points[1], lengths[1]));
-		points.push_back(circleCircleIntersection(points[2], lengths[3], points[3], lengths[4]));
-	}
+	return fourbar::forwardKinematics(ground_points[0], ground_points[1], lengths, theta, prev_points, point_flows, points);
 }
 
 void Canvas::stepForward() {
 	theta += speed;
-	std::vector<glm::dvec2> prev_points = points;
-	try {
-		forwardKinematics();
+	if (forwardKinematics()) {
 		point_flows.clear();
 		if (prev_points.size() == points.size()) {
 			for (int i = 0; i < points.size(); ++i) {
@@ -114,9 +65,9 @@ void Canvas::stepForward() {
 			}
 		}
 	}
-	catch (char* ex) {
+	else {
 		point_flows.clear();
-		points = prev_points;
+		points.assign(prev_points.begin(), prev_points.end());
 		theta -= speed;
 		speed = -speed;
 	}
@@ -124,7 +75,6 @@ void Canvas::stepForward() {
 	// update the trace of the end-effector
 	if (points.size() >= 5) {
 		trace.push_back(points[4]);
-		if (trace.size() > 400) trace.erase(trace.begin());
 	}
 
 	update();
@@ -132,10 +82,7 @@ void Canvas::stepForward() {
 
 void Canvas::stepBackward() {
 	theta -= speed;
-	try {
-		forwardKinematics();
-	}
-	catch (char* ex) {
+	if (!forwardKinematics()) {
 		theta += speed;
 		speed = -speed;
 	}
@@ -143,7 +90,6 @@ void Canvas::stepBackward() {
 	// update the trace of the end-effector
 	if (points.size() >= 5) {
 		trace.push_back(points[4]);
-		if (trace.size() > 400) trace.erase(trace.begin());
 	}
 
 	update();
@@ -166,95 +112,105 @@ void Canvas::stop() {
 	}
 }
 
+/**
+ * Load a design. A malformed file throws a QString with the line and column of the error.
+ */
 void Canvas::open(const QString& filename) {
 	QFile file(filename);
 	if (!file.open(QFile::ReadOnly | QFile::Text)) throw "Fild cannot open.";
 
-	QDomDocument doc;
-	doc.setContent(&file);
-
-	QDomElement root = doc.documentElement();
-	if (root.tagName() != "design")	throw "Invalid file format.";
-
-	// clear the data
-	ground_points.clear();
-	lengths.clear();
-	trace.clear();
-	points.clear();
-	point_flows.clear();
+	QXmlStreamReader xml(&file);
+	if (!xml.readNextStartElement() || xml.name() != "design") {
+		if (!xml.hasError()) xml.raiseError("Invalid file format.");
+	}
 
-	QDomNode node = root.firstChild();
-	while (!node.isNull()) {
-		if (node.toElement().tagName() == "ground_points") {
-			theta = node.toElement().attribute("initial_phase").toDouble();
+	std::vector<glm::dvec2> new_ground_points;
+	std::vector<double> new_lengths;
+	double new_theta = theta;
+	while (!xml.hasError() && xml.readNextStartElement()) {
+		if (xml.name() == "ground_points") {
+			new_theta = xml.attributes().value("initial_phase").toDouble();
 
-			QDomNode point_node = node.firstChild();
-			while (!point_node.isNull()) {
-				if (point_node.toElement().tagName() == "ground_point") {
+			while (xml.readNextStartElement()) {
+				if (xml.name() == "ground_point") {
 					// add a ground point
-					double x = point_node.toElement().attribute("x").toDouble();
-					double y = point_node.toElement().attribute("y").toDouble();
-					ground_points.push_back(glm::vec2(x, y));
+					double x = xml.attributes().value("x").toDouble();
+					double y = xml.attributes().value("y").toDouble();
+					new_ground_points.push_back(glm::dvec2(x, y));
 				}
-
-				point_node = point_node.nextSibling();
+				xml.skipCurrentElement();
 			}
 		}
-		else if (node.toElement().tagName() == "lengths") {
-			QDomNode length_node = node.firstChild();
-			while (!length_node.isNull()) {
-				if (length_node.toElement().tagName() == "length") {
-					// add a ground point
-					double length = length_node.toElement().attribute("value").toDouble();
-					lengths.push_back(length);
+		else if (xml.name() == "lengths") {
+			while (xml.readNextStartElement()) {
+				if (xml.name() == "length") {
+					// add a length
+					double length = xml.attributes().value("value").toDouble();
+					new_lengths.push_back(length);
 				}
-
-				length_node = length_node.nextSibling();
+				xml.skipCurrentElement();
 			}
 		}
+		else {
+			xml.skipCurrentElement();
+		}
+	}
+
+	// read to the end so that trailing garbage is reported, too
+	while (!xml.atEnd()) xml.readNext();
 
-		node = node.nextSibling();
+	if (xml.hasError()) {
+		throw QString("line %1, column %2: %3").arg(xml.lineNumber()).arg(xml.columnNumber()).arg(xml.errorString());
 	}
 
+	// replace the data
+	ground_points = new_ground_points;
+	lengths = new_lengths;
+	theta = new_theta;
+	trace.clear();
+	points.clear();
+	point_flows.clear();
+
 	forwardKinematics();
 	update();
 }
 
 void Canvas::save(const QString& filename) {
 	QFile file(filename);
-	if (!file.open(QFile::WriteOnly)) throw "File cannot open.";
+	if (!file.open(QFile::WriteOnly | QFile::Text)) throw "File cannot open.";
 
-	QDomDocument doc;
+	QXmlStreamWriter xml(&file);
+	xml.setAutoFormatting(true);
+	xml.setAutoFormattingIndent(4);
+	xml.writeStartDocument();
 
 	// set root node
-	QDomElement root = doc.createElement("design");
-	root.setAttribute("author", "Gen Nishida");
-	root.setAttribute("version", "1.0");
-	root.setAttribute("date", QDate::currentDate().toString("MM/dd/yyyy"));
-	doc.appendChild(root);
+	xml.writeStartElement("design");
+	xml.writeAttribute("author", "Gen Nishida");
+	xml.writeAttribute("version", "1.0");
+	xml.writeAttribute("date", QDate::currentDate().toString("MM/dd/yyyy"));
 
 	// write points
-	QDomElement points_node = doc.createElement("ground_points");
-	points_node.setAttribute("initial_phase", theta);
-	root.appendChild(points_node);
+	xml.writeStartElement("ground_points");
+	xml.writeAttribute("initial_phase", QString::number(theta));
 	for (int i = 0; i < ground_points.size(); ++i) {
-		QDomElement point_node = doc.createElement("ground_point");
-		point_node.setAttribute("x", ground_points[i].x);
-		point_node.setAttribute("y", ground_points[i].y);
-		points_node.appendChild(point_node);
+		xml.writeStartElement("ground_point");
+		xml.writeAttribute("x", QString::number(ground_points[i].x));
+		xml.writeAttribute("y", QString::number(ground_points[i].y));
+		xml.writeEndElement();
 	}
+	xml.writeEndElement();
 
 	// write lengths
-	QDomElement lengths_node = doc.createElement("lengths");
-	root.appendChild(lengths_node);
+	xml.writeStartElement("lengths");
 	for (int i = 0; i < lengths.size(); ++i) {
-		QDomElement length_node = doc.createElement("length");
-		length_node.setAttribute("value", lengths[i]);
-		lengths_node.appendChild(length_node);
+		xml.writeStartElement("length");
+		xml.writeAttribute("value", QString::number(lengths[i]));
+		xml.writeEndElement();
 	}
+	xml.writeEndElement();
 
-	QTextStream out(&file);
-	doc.save(out, 4);
+	xml.writeEndDocument();
 }
 
 void Canvas::animation_update() {
@@ -287,12 +243,7 @@ void Canvas::paintEvent(QPaintEvent *e) {
 	}
 
 	// draw trace
-	if (trace.size() > 0) {
-		painter.setPen(QPen(QColor(0, 0, 255), 2));
-		for (int i = 0; i < trace.size() - 1; ++i) {
-			painter.drawLine(trace[i].x, trace[i].y, trace[i + 1].x, trace[i + 1].y);
-		}
-	}
+	trace_painter.draw(painter, trace, QPen(QColor(0, 0, 255), 2));
 }
 
 void Canvas::mousePressEvent(QMouseEvent* e) {
@@ -339,10 +290,7 @@ void Canvas::mouseMoveEvent(QMouseEvent* e) {
 			lengths[4] = glm::length(glm::dvec2(e->x(), e->y()) - points[3]);
 		}
 
-		try {
-			forwardKinematics();
-		}
-		catch (char* ex) {
+		if (!forwardKinematics()) {
 			ground_points = prev_ground_points;
 			points = prev_points;
 			lengths = prev_lengths;
@@ -6,6 +6,8 @@
 #include <glm/glm.hpp>
 //#include <boost/shared_ptr.hpp>
 #include <QTimer>
+#include "RingBuffer.h"
+#include "TracePainter.h"
 
 class Canvas : public QWidget {
 Q_OBJECT
@@ -16,11 +18,13 @@ public:
 
 	std::vector<glm::dvec2> ground_points;
 	std::vector<glm::dvec2> points;
+	std::vector<glm::dvec2> prev_points;
 	std::vector<glm::dvec2> point_flows;
 	std::vector<double> lengths;
 	double theta;
 	QTimer* animation_timer;
-	std::vector<glm::dvec2> trace;
+	RingBuffer<glm::dvec2> trace;
+	TracePainter trace_painter;
 	int selected_point_id;
 	double speed;
 
@@ -28,7 +32,7 @@ public:
 	Canvas(QWidget *parent = NULL);
     ~Canvas();
 
-	void forwardKinematics();
+	bool forwardKinematics();
 	void stepForward();
 	void stepBackward();
 	void run();
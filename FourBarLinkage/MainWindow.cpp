@@ -1,5 +1,6 @@
 #include "MainWindow.h"
 #include <QFileDialog>
+#include <QMessageBox>
 
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
 	ui.setupUi(this);
@@ -24,7 +25,15 @@ void MainWindow::onOpen() {
 	QString filename = QFileDialog::getOpenFileName(this, tr("Open Design file..."), "", tr("Design Files (*.xml)"));
 	if (filename.isEmpty()) return;
 
-	canvas.open(filename);
+	try {
+		canvas.open(filename);
+	}
+	catch (const char* ex) {
+		QMessageBox::warning(this, "Error message", ex);
+	}
+	catch (const QString& ex) {
+		QMessageBox::warning(this, "Error message", ex);
+	}
 }
 
 void MainWindow::onSave() {
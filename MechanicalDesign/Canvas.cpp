@@ -13,37 +13,235 @@
 #define SQR(x)	((x) * (x))
 #endif
 
+namespace {
+	// distance in pixels within which the items under the mouse are highlighted
+	const float HOVER_TOLERANCE = 5;
+
+	// editors may save a file in several writes, so it is reloaded once it has been quiet for this many milliseconds
+	const int RELOAD_DELAY = 200;
+}
+
 Canvas::Canvas(QWidget *parent) : QWidget(parent) {
 	ctrlPressed = false;
 	shiftPressed = false;
 
 	animation_timer = NULL;
+	use_simulation_thread = false;
+	simulation_thread = NULL;
+	resume_simulation_thread = false;
+	preview = NULL;
+	feasibility = NULL;
+	cycle_simulation = NULL;
 	selected_gear = NULL;
+	setMouseTracking(true);
+
+	watch_file = true;
+	watch_directory = false;
+	watcher = new QFileSystemWatcher(this);
+	connect(watcher, SIGNAL(fileChanged(const QString&)), this, SLOT(designChanged(const QString&)));
+	connect(watcher, SIGNAL(directoryChanged(const QString&)), this, SLOT(designChanged(const QString&)));
+	reload_timer = new QTimer(this);
+	reload_timer->setSingleShot(true);
+	connect(reload_timer, SIGNAL(timeout()), this, SLOT(reload()));
 	
 	//ass->forward(1.5);
-	try {
-		kinematics.forwardKinematics();
-	}
-	catch (char* ex) {
+	kinematics::SolveStatus status = kinematics.forwardKinematics();
+	if (!status.ok()) {
 		std::cerr << "Initialization error:" << std::endl;
-		std::cerr << ex << std::endl;
+		std::cerr << status.message().toUtf8().constData() << std::endl;
 	}
 }
 
 Canvas::~Canvas() {
+	stopSimulationThread();
+	clearPreview();
+	clearFeasibility();
+	clearCycleSimulation();
 }
 
 void Canvas::open(const QString& filename) {
-	kinematics.load(filename);
+	clearPreview();
+	clearFeasibility();
+	bool running = stopSimulationThread();
+	try {
+		kinematics.load(filename);
+	}
+	catch (...) {
+		// a rejected file leaves the current design as it is
+		if (running) startSimulationThread();
+		throw;
+	}
+	hover_item = kinematics::PickItem();
+	selected_gear = NULL;
+	pick_index.clear();
+
+	// the design as it is in the file, against which the changes to the file are diffed
+	design_filename = filename;
+	kinematics.copyTo(file_design);
+	updateWatcher();
+
+	// an unchanged design replays the cached cycle instead of solving it again, and
+	// a new one is simulated in the background for the next time
+	clearCycleSimulation();
+	kinematics::CycleResult cycle;
+	if (simulation_cache.find(kinematics, cycle)) {
+		cycle.applyFrames(kinematics);
+		if (!cycle.valid()) {
+			std::cerr << "Step " << cycle.failure_step << ": " << cycle.failure.message().toUtf8().constData() << std::endl;
+		}
+	}
+	else {
+		cycle_simulation = new CycleSimulation(kinematics, simulation_cache, this);
+		cycle_simulation->start();
+	}
+
+	if (running) startSimulationThread();
 	update();
+	emit designLoaded();
 }
 
+/**
+ * Save the design, and keep watching it under the new name. The saved file is read
+ * back as the design in the file, so that reloading it does not apply the current
+ * phases once more. If it cannot be read back, the saved design is used instead.
+ */
 void Canvas::save(const QString& filename) {
-	kinematics.save(filename); 
+	kinematics.save(filename);
+
+	design_filename = filename;
+	try {
+		file_design.load(filename);
+	}
+	catch (const char* ex) {
+		std::cerr << filename.toUtf8().constData() << ": " << ex << std::endl;
+		kinematics.copyTo(file_design);
+	}
+	catch (const QString& ex) {
+		std::cerr << filename.toUtf8().constData() << ": " << ex.toUtf8().constData() << std::endl;
+		kinematics.copyTo(file_design);
+	}
+	updateWatcher();
+}
+
+void Canvas::watchFile(bool flag) {
+	watch_file = flag;
+	updateWatcher();
+}
+
+/**
+ * Also watch the other designs in the directory of the open one. When one of them
+ * is saved, it is opened instead.
+ */
+void Canvas::watchDirectory(bool flag) {
+	watch_directory = flag;
+	updateWatcher();
+}
+
+/**
+ * Watch the open design, and the directory with its designs if enabled. The paths
+ * are added again each time, since the watcher drops a file when an editor saves
+ * it by replacing it.
+ */
+void Canvas::updateWatcher() {
+	QStringList paths = watcher->files() + watcher->directories();
+	if (!paths.isEmpty()) watcher->removePaths(paths);
+	if (design_filename.isEmpty()) return;
+
+	paths.clear();
+	if (watch_file && QFileInfo(design_filename).exists()) paths.push_back(design_filename);
+	if (watch_directory) {
+		QDir dir = QFileInfo(design_filename).absoluteDir();
+		paths.push_back(dir.absolutePath());
+		QFileInfoList entries = dir.entryInfoList(QStringList() << "*.xml" << "*.mdb", QDir::Files);
+		for (int i = 0; i < entries.size(); ++i) {
+			if (entries[i].absoluteFilePath() != QFileInfo(design_filename).absoluteFilePath()) paths.push_back(entries[i].filePath());
+		}
+	}
+	if (!paths.isEmpty()) watcher->addPaths(paths);
+}
+
+void Canvas::designChanged(const QString& path) {
+	// a change to another design in the watched directory switches to it
+	if (path != design_filename && QFileInfo(path).isFile()) pending_filename = path;
+	reload_timer->start(RELOAD_DELAY);
+}
+
+/**
+ * Read the changed design file again and diff it against the design. If only
+ * numeric parameters changed, e.g., a gear radius, a phase or a link length, they
+ * are patched into the running mechanism and only the affected points are solved
+ * again, so that the animation and the traces go on. Otherwise the design is
+ * opened from scratch. A file that cannot be read, e.g., in the middle of being
+ * saved, is reported and the current design is kept.
+ */
+void Canvas::reload() {
+	QString filename = pending_filename.isEmpty() ? design_filename : pending_filename;
+	pending_filename.clear();
+	updateWatcher();
+	if (filename.isEmpty()) return;
+
+	try {
+		if (filename != design_filename) {
+			open(filename);
+			return;
+		}
+
+		kinematics::Kinematics design;
+		design.load(filename);
+		if (!kinematics.sameStructure(design)) {
+			open(filename);
+			return;
+		}
+
+		bool running = stopSimulationThread();
+		clearPreview();
+		clearFeasibility();
+
+		if (kinematics.patch(file_design, design) > 0) {
+			// the body outlines may have changed without their pivots moving
+			pick_index.clear();
+			kinematics::SolveStatus status = kinematics.forwardKinematicsIncremental();
+			if (!status.ok()) {
+				std::cerr << "Reload error:" << std::endl;
+				std::cerr << status.message().toUtf8().constData() << std::endl;
+			}
+			kinematics.invalidateFrameCache();
+		}
+		file_design = design;
+
+		if (running) startSimulationThread();
+		update();
+		emit designLoaded();
+	}
+	catch (const char* ex) {
+		std::cerr << filename.toUtf8().constData() << ": " << ex << std::endl;
+	}
+	catch (const QString& ex) {
+		std::cerr << filename.toUtf8().constData() << ": " << ex.toUtf8().constData() << std::endl;
+	}
+}
+
+/**
+ * Report the failure of the cycle simulated in the background. Its frames are not
+ * taken over, since the design may have been stepped or changed in the meantime,
+ * and the frames are recorded as it is stepped anyway. A notification from the
+ * simulation of a previously opened design is ignored.
+ */
+void Canvas::cycleSimulated() {
+	if (cycle_simulation == NULL || !cycle_simulation->done) return;
+
+	if (!cycle_simulation->result.valid()) {
+		std::cerr << "Step " << cycle_simulation->result.failure_step << ": " << cycle_simulation->result.failure.message().toUtf8().constData() << std::endl;
+	}
+	clearCycleSimulation();
 }
 
 void Canvas::run() {
+	clearPreview();
+
 	if (animation_timer == NULL) {
+		if (use_simulation_thread) startSimulationThread();
+
 		animation_timer = new QTimer(this);
 		connect(animation_timer, SIGNAL(timeout()), this, SLOT(animation_update()));
 		animation_timer->start(10);
@@ -52,12 +250,99 @@ void Canvas::run() {
 
 void Canvas::stop() {
 	if (animation_timer != NULL) {
+		stopSimulationThread();
+
 		animation_timer->stop();
 		delete animation_timer;
 		animation_timer = NULL;
 	}
 }
 
+/**
+ * Step the mechanism in a separate thread instead of in the animation timer.
+ * The switch takes effect immediately if the animation is running.
+ */
+void Canvas::setSimulationThread(bool flag) {
+	use_simulation_thread = flag;
+
+	if (animation_timer != NULL) {
+		if (flag) startSimulationThread();
+		else stopSimulationThread();
+	}
+}
+
+void Canvas::startSimulationThread() {
+	if (simulation_thread != NULL) return;
+
+	simulation_thread = new SimulationThread(kinematics, 10);
+	simulation_thread->start();
+}
+
+/**
+ * Stop the simulation thread, and take over its latest state so that the
+ * mechanism can be edited or stepped here. Return whether the thread was running.
+ */
+bool Canvas::stopSimulationThread() {
+	if (simulation_thread == NULL) return false;
+
+	simulation_thread->stop();
+	simulation_thread->snapshots.update();
+	kinematics.applySnapshot(simulation_thread->snapshots.readBuffer());
+
+	delete simulation_thread;
+	simulation_thread = NULL;
+
+	return true;
+}
+
+/**
+ * Start computing the end-effector trajectories over one cycle from the current
+ * state in the background, canceling the previous computation. They are drawn
+ * when they are ready.
+ */
+void Canvas::startPreview() {
+	clearPreview();
+
+	preview = new TrajectoryPreview(kinematics);
+	connect(preview, SIGNAL(finished()), this, SLOT(update()));
+	preview->start();
+}
+
+void Canvas::clearPreview() {
+	if (preview != NULL) {
+		preview->cancel();
+		delete preview;
+		preview = NULL;
+	}
+}
+
+/**
+ * Start computing in the background where the gear can be moved without breaking
+ * the mechanism during the cycle. The map is drawn level by level as it is refined.
+ */
+void Canvas::startFeasibility(int assembly, int gear) {
+	clearFeasibility();
+
+	feasibility = new FeasibilityMap(kinematics, assembly, gear, this);
+	feasibility->start();
+}
+
+void Canvas::clearFeasibility() {
+	if (feasibility != NULL) {
+		feasibility->cancel();
+		delete feasibility;
+		feasibility = NULL;
+	}
+	overlay_painter.clearFeasibility();
+}
+
+void Canvas::clearCycleSimulation() {
+	if (cycle_simulation != NULL) {
+		delete cycle_simulation;
+		cycle_simulation = NULL;
+	}
+}
+
 void Canvas::showAssemblies(bool flag) {
 	kinematics.showAssemblies(flag);
 	update();
@@ -73,15 +358,29 @@ void Canvas::showBodies(bool flag) {
 	update();
 }
 
+void Canvas::fadeTraces(bool flag) {
+	kinematics.fadeTraces(flag);
+	update();
+}
+
 void Canvas::animation_update() {
-	try {
-		kinematics.stepForward();
+	// the thread steps the mechanism, and only the painting is done here
+	if (simulation_thread != NULL) {
+		if (simulation_thread->failed) {
+			std::cerr << "Animation is stopped by error:" << std::endl;
+			std::cerr << simulation_thread->error.toUtf8().constData() << std::endl;
+			stop();
+		}
+
+		update();
+		return;
 	}
-	catch (char* ex) {
-		//kinematics.stepBackward();
+
+	kinematics::SolveStatus status = kinematics.stepForward();
+	if (!status.ok()) {
 		stop();
 		std::cerr << "Animation is stopped by error:" << std::endl;
-		std::cerr << ex << std::endl;
+		std::cerr << status.message().toUtf8().constData() << std::endl;
 	}
 
 	update();
@@ -90,21 +389,31 @@ void Canvas::animation_update() {
 void Canvas::paintEvent(QPaintEvent *e) {
 	QPainter painter(this);
 
+	if (simulation_thread != NULL && simulation_thread->snapshots.update()) {
+		kinematics.applySnapshot(simulation_thread->snapshots.readBuffer());
+	}
+
+	if (feasibility != NULL) {
+		// a level is rendered into an image once, when it arrives, and the repaints during the drag only draw it
+		if (feasibility->levels.update()) overlay_painter.setFeasibility(feasibility->levels.readBuffer());
+		overlay_painter.drawFeasibility(painter);
+	}
+
 	kinematics.draw(painter);
+
+	if (preview != NULL && preview->isFinished()) overlay_painter.drawPreview(painter, preview->trajectories);
+	if (hover_item.type != kinematics::PickItem::NONE) overlay_painter.drawHighlight(painter, kinematics, hover_item);
 }
 
 void Canvas::mousePressEvent(QMouseEvent* e) {
 	// hit test against gears
-	for (int i = 0; i < kinematics.assemblies.size(); ++i) {
-		for (int j = 0; j < kinematics.assemblies[i]->gears.size(); ++j) {
-			float dist = glm::length(kinematics.assemblies[i]->gears[j].center - glm::vec2(e->x(), e->y()));
-			if (dist <= kinematics.assemblies[i]->gears[j].radius) {
-				// select this gear
-				selected_gear = &kinematics.assemblies[i]->gears[j];
-				prev_mouse_pt = glm::vec2(e->x(), e->y());
-				break;
-			}
-		}
+	kinematics::PickItem item = pick_index.pick(kinematics, glm::vec2(e->x(), e->y()), 0, kinematics::PickItem::GEAR);
+	if (item.type == kinematics::PickItem::GEAR) {
+		// select this gear, and step the mechanism here while the gear is dragged
+		if (stopSimulationThread()) resume_simulation_thread = true;
+		selected_gear = &kinematics.assemblies[item.index]->gears[item.sub];
+		prev_mouse_pt = glm::vec2(e->x(), e->y());
+		startFeasibility(item.index, item.sub);
 	}
 }
 
@@ -113,12 +422,30 @@ void Canvas::mouseMoveEvent(QMouseEvent* e) {
 		// move this gear
 		selected_gear->center += glm::vec2(e->x(), e->y()) - prev_mouse_pt;
 		prev_mouse_pt = glm::vec2(e->x(), e->y());
+		kinematics.invalidateFrameCache();
 		update();
 	}
+	else {
+		// highlight the item under the mouse
+		kinematics::PickItem item = pick_index.pick(kinematics, glm::vec2(e->x(), e->y()), HOVER_TOLERANCE);
+		if (item != hover_item) {
+			hover_item = item;
+			update();
+		}
+	}
 }
 
 void Canvas::mouseReleaseEvent(QMouseEvent* e) {
 	selected_gear = NULL;
+	if (feasibility != NULL) {
+		clearFeasibility();
+		update();
+	}
+
+	if (resume_simulation_thread) {
+		startSimulationThread();
+		resume_simulation_thread = false;
+	}
 }
 
 void Canvas::mouseDoubleClickEvent(QMouseEvent* e) {
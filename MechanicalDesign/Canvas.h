@@ -6,7 +6,15 @@
 #include <glm/glm.hpp>
 #include <boost/shared_ptr.hpp>
 #include "Kinematics.h"
+#include "SimulationThread.h"
+#include "TrajectoryPreview.h"
+#include "FeasibilityMap.h"
+#include "PickIndex.h"
+#include "OverlayPainter.h"
+#include "SimulationCache.h"
+#include "CycleSimulation.h"
 #include <QTimer>
+#include <QFileSystemWatcher>
 
 class Canvas : public QWidget {
 Q_OBJECT
@@ -16,9 +24,26 @@ public:
 	bool shiftPressed;
 
 	kinematics::Kinematics kinematics;
+	kinematics::SimulationCache simulation_cache;
+	CycleSimulation* cycle_simulation;
 	QTimer* animation_timer;
+	bool use_simulation_thread;
+	SimulationThread* simulation_thread;
+	bool resume_simulation_thread;
+	TrajectoryPreview* preview;
+	OverlayPainter overlay_painter;
+	FeasibilityMap* feasibility;
+	kinematics::PickIndex pick_index;
+	kinematics::PickItem hover_item;
 	kinematics::Gear* selected_gear;
 	glm::vec2 prev_mouse_pt;
+	QString design_filename;
+	kinematics::Kinematics file_design;
+	QFileSystemWatcher* watcher;
+	QTimer* reload_timer;
+	QString pending_filename;
+	bool watch_file;
+	bool watch_directory;
 
 public:
 	Canvas(QWidget *parent = NULL);
@@ -28,12 +53,30 @@ public:
 	void save(const QString& filename);
 	void run();
 	void stop();
+	void setSimulationThread(bool flag);
+	void startSimulationThread();
+	bool stopSimulationThread();
+	void startPreview();
+	void clearPreview();
+	void startFeasibility(int assembly, int gear);
+	void clearFeasibility();
+	void clearCycleSimulation();
 	void showAssemblies(bool flag);
 	void showLinks(bool flag);
 	void showBodies(bool flag);
+	void fadeTraces(bool flag);
+	void watchFile(bool flag);
+	void watchDirectory(bool flag);
+	void updateWatcher();
+
+signals:
+	void designLoaded();
 
 public slots:
 	void animation_update();
+	void designChanged(const QString& path);
+	void reload();
+	void cycleSimulated();
 
 protected:
 	void paintEvent(QPaintEvent* e);
@@ -0,0 +1,23 @@
+#include "CycleSimulation.h"
+
+/**
+ * The design is copied, so that the given one can keep being used by the GUI thread.
+ */
+CycleSimulation::CycleSimulation(const kinematics::Kinematics& kinematics, const kinematics::SimulationCache& cache, QObject* receiver) : cache(cache), receiver(receiver), done(false) {
+	kinematics.copyTo(this->kinematics);
+}
+
+/**
+ * Wait for the simulation to finish, so that the entry is still written.
+ */
+CycleSimulation::~CycleSimulation() {
+	wait();
+}
+
+void CycleSimulation::run() {
+	kinematics::simulateCycle(kinematics, result);
+	cache.save(kinematics.designHash(), result);
+	done = true;
+
+	if (receiver != NULL) QMetaObject::invokeMethod(receiver, "cycleSimulated", Qt::QueuedConnection);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <QThread>
+#include <atomic>
+#include "Kinematics.h"
+#include "SimulationCache.h"
+
+/**
+ * Background simulation of the full cycle of a design that is not in the cache
+ * yet, so that opening it does not block the GUI. The result is written to the
+ * cache, and the receiver, if any, is notified through its cycleSimulated slot.
+ * The simulation works on a copy of the design.
+ */
+class CycleSimulation : public QThread {
+public:
+	kinematics::Kinematics kinematics;
+	kinematics::SimulationCache cache;
+	kinematics::CycleResult result;
+	QObject* receiver;
+	std::atomic<bool> done;
+
+public:
+	CycleSimulation(const kinematics::Kinematics& kinematics, const kinematics::SimulationCache& cache, QObject* receiver = NULL);
+	~CycleSimulation();
+
+protected:
+	void run();
+};
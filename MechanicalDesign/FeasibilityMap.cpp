@@ -0,0 +1,137 @@
+#include "FeasibilityMap.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace {
+	// number of cells evaluated by a task, after each of which the cancellation is checked
+	const int CHUNK_SIZE = 16;
+
+	// the cycles of non-periodic mechanisms are checked for one turn of the crank
+	const float PI = 3.141592653f;
+
+	bool feasible(float value) {
+		return value >= 1;
+	}
+}
+
+/**
+ * The design is copied, so that the given one can keep being used (and the gear
+ * dragged) by the GUI thread.
+ */
+FeasibilityMap::FeasibilityMap(const kinematics::Kinematics& kinematics, int assembly, int gear, QObject* receiver) : assembly(assembly), gear(gear), receiver(receiver), canceled(false) {
+	kinematics.copyTo(this->kinematics);
+	center = kinematics.assemblies[assembly]->gears[gear].center;
+
+	float period = kinematics.cyclePeriod();
+	if (period == 0) period = PI * 2;
+	num_steps = ceilf(period / kinematics.time_step);
+}
+
+FeasibilityMap::~FeasibilityMap() {
+	cancel();
+}
+
+/**
+ * Stop the computation and wait for the thread to finish.
+ */
+void FeasibilityMap::cancel() {
+	canceled = true;
+	wait();
+}
+
+void FeasibilityMap::run() {
+	kinematics::KinematicsSolver<float> base(kinematics);
+
+	FeasibilityLevel level;
+	level.size = COARSE_GRID_SIZE;
+	level.cell_size = COARSE_CELL_SIZE;
+	level.origin = center - glm::vec2(COARSE_GRID_SIZE, COARSE_GRID_SIZE) * (COARSE_CELL_SIZE * 0.5f);
+	level.values.resize(level.size * level.size);
+
+	std::vector<int> cells(level.values.size());
+	for (int i = 0; i < cells.size(); ++i) cells[i] = i;
+	evaluate(base, cells, level);
+	if (canceled) return;
+	publish(level);
+
+	for (int l = 0; l < NUM_REFINEMENTS && !canceled; ++l) {
+		FeasibilityLevel fine;
+		fine.size = level.size * 2;
+		fine.cell_size = level.cell_size * 0.5f;
+		fine.origin = level.origin;
+		fine.values.resize(fine.size * fine.size);
+
+		// the children of the boundary cells are evaluated, and the others take over the values of their parents
+		cells.clear();
+		for (int j = 0; j < level.size; ++j) {
+			for (int i = 0; i < level.size; ++i) {
+				float v = level.value(i, j);
+				bool boundary = (i > 0 && feasible(level.value(i - 1, j)) != feasible(v))
+					|| (i < level.size - 1 && feasible(level.value(i + 1, j)) != feasible(v))
+					|| (j > 0 && feasible(level.value(i, j - 1)) != feasible(v))
+					|| (j < level.size - 1 && feasible(level.value(i, j + 1)) != feasible(v));
+
+				for (int dj = 0; dj < 2; ++dj) {
+					for (int di = 0; di < 2; ++di) {
+						int index = (j * 2 + dj) * fine.size + i * 2 + di;
+						fine.values[index] = v;
+						if (boundary) cells.push_back(index);
+					}
+				}
+			}
+		}
+		if (cells.empty()) break;
+
+		evaluate(base, cells, fine);
+		if (canceled) return;
+		publish(fine);
+		std::swap(level, fine);
+	}
+}
+
+/**
+ * Evaluate the given cells of the level in parallel. Each task runs its own copy
+ * of the solver.
+ */
+void FeasibilityMap::evaluate(const kinematics::KinematicsSolver<float>& base, const std::vector<int>& cells, FeasibilityLevel& level) {
+	ThreadPool pool;
+	for (int k = 0; k < cells.size(); k += CHUNK_SIZE) {
+		int end = std::min(k + CHUNK_SIZE, (int)cells.size());
+		pool.submit([this, &base, &cells, &level, k, end]() {
+			if (canceled) return;
+
+			kinematics::KinematicsSolver<float> solver(base);
+			for (int c = k; c < end; ++c) {
+				int index = cells[c];
+				level.values[index] = cycleFraction(solver, base, level.cellCenter(index % level.size, index / level.size));
+			}
+		});
+	}
+	pool.wait();
+}
+
+/**
+ * Run the mechanism through the cycle from the current state of the design with
+ * the gear moved to the given center, and return the fraction of the cycle before
+ * the first failure.
+ */
+float FeasibilityMap::cycleFraction(kinematics::KinematicsSolver<float>& solver, const kinematics::KinematicsSolver<float>& base, const glm::vec2& center) const {
+	// the clocks start over with the parameters
+	solver = base;
+	solver.params[solver.gearParam(assembly, gear, kinematics::KinematicsSolver<float>::CENTER_X)] = center.x;
+	solver.params[solver.gearParam(assembly, gear, kinematics::KinematicsSolver<float>::CENTER_Y)] = center.y;
+
+	for (int k = 0; k < num_steps; ++k) {
+		if (!solver.forwardKinematics().ok()) return (float)k / num_steps;
+		solver.advance(kinematics.time_step);
+	}
+
+	return 1;
+}
+
+void FeasibilityMap::publish(const FeasibilityLevel& level) {
+	levels.writeBuffer() = level;
+	levels.publish();
+
+	if (receiver != NULL) QMetaObject::invokeMethod(receiver, "update", Qt::QueuedConnection);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QThread>
+#include <atomic>
+#include "Kinematics.h"
+#include "KinematicsSolver.h"
+#include "TripleBuffer.h"
+
+/**
+ * Full-cycle feasibility of the candidate centers of a gear over a square grid of
+ * cells. Each value is the fraction of the cycle that the mechanism runs through,
+ * with the gear centered at the cell, before it fails, so 1 means feasible.
+ */
+class FeasibilityLevel {
+public:
+	glm::vec2 origin;
+	float cell_size;
+	int size;
+	std::vector<float> values;
+
+public:
+	FeasibilityLevel() : cell_size(0), size(0) {}
+
+	float value(int i, int j) const { return values[j * size + i]; }
+	glm::vec2 cellCenter(int i, int j) const { return origin + glm::vec2(i + 0.5f, j + 0.5f) * cell_size; }
+};
+
+/**
+ * Background computation of where a gear can be moved without breaking the
+ * mechanism anywhere in the cycle. The candidate centers around the gear are
+ * evaluated on a coarse grid in parallel, and then the cells on the boundary
+ * between the feasible and the infeasible regions are subdivided level by level.
+ * Each finished level is published, and the receiver, if any, is asked to update.
+ * The computation works on a copy of the design and can be canceled.
+ */
+class FeasibilityMap : public QThread {
+public:
+	// the coarse grid covers COARSE_GRID_SIZE cells of COARSE_CELL_SIZE pixels in each
+	// direction around the gear, and its boundary cells are subdivided NUM_REFINEMENTS
+	// times, i.e., down to 2 pixels
+	enum { COARSE_GRID_SIZE = 24, COARSE_CELL_SIZE = 16, NUM_REFINEMENTS = 3 };
+
+	kinematics::Kinematics kinematics;
+	int assembly;
+	int gear;
+	glm::vec2 center;
+	int num_steps;
+	QObject* receiver;
+	TripleBuffer<FeasibilityLevel> levels;
+	std::atomic<bool> canceled;
+
+public:
+	FeasibilityMap(const kinematics::Kinematics& kinematics, int assembly, int gear, QObject* receiver = NULL);
+	~FeasibilityMap();
+
+	void cancel();
+
+protected:
+	void run();
+
+private:
+	void evaluate(const kinematics::KinematicsSolver<float>& base, const std::vector<int>& cells, FeasibilityLevel& level);
+	float cycleFraction(kinematics::KinematicsSolver<float>& solver, const kinematics::KinematicsSolver<float>& base, const glm::vec2& center) const;
+	void publish(const FeasibilityLevel& level);
+};
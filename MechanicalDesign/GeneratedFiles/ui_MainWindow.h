@@ -33,9 +33,13 @@ public:
     QAction *actionShowAll;
     QAction *actionShowLinks;
     QAction *actionShowBodies;
+    QAction *actionFadeTraces;
     QAction *actionOpen;
     QAction *actionSave;
+    QAction *actionSimulationThread;
     QAction *actionPhaseControl;
+    QAction *actionWatchFile;
+    QAction *actionWatchDirectory;
     QWidget *centralWidget;
     QMenuBar *menuBar;
     QMenu *menuFile;
@@ -66,12 +70,24 @@ public:
         actionShowBodies = new QAction(MainWindowClass);
         actionShowBodies->setObjectName(QStringLiteral("actionShowBodies"));
         actionShowBodies->setCheckable(true);
+        actionFadeTraces = new QAction(MainWindowClass);
+        actionFadeTraces->setObjectName(QStringLiteral("actionFadeTraces"));
+        actionFadeTraces->setCheckable(true);
         actionOpen = new QAction(MainWindowClass);
         actionOpen->setObjectName(QStringLiteral("actionOpen"));
         actionSave = new QAction(MainWindowClass);
         actionSave->setObjectName(QStringLiteral("actionSave"));
+        actionSimulationThread = new QAction(MainWindowClass);
+        actionSimulationThread->setObjectName(QStringLiteral("actionSimulationThread"));
+        actionSimulationThread->setCheckable(true);
         actionPhaseControl = new QAction(MainWindowClass);
         actionPhaseControl->setObjectName(QStringLiteral("actionPhaseControl"));
+        actionWatchFile = new QAction(MainWindowClass);
+        actionWatchFile->setObjectName(QStringLiteral("actionWatchFile"));
+        actionWatchFile->setCheckable(true);
+        actionWatchDirectory = new QAction(MainWindowClass);
+        actionWatchDirectory->setObjectName(QStringLiteral("actionWatchDirectory"));
+        actionWatchDirectory->setCheckable(true);
         centralWidget = new QWidget(MainWindowClass);
         centralWidget->setObjectName(QStringLiteral("centralWidget"));
         MainWindowClass->setCentralWidget(centralWidget);
@@ -98,9 +114,13 @@ public:
         menuFile->addAction(actionOpen);
         menuFile->addAction(actionSave);
         menuFile->addSeparator();
+        menuFile->addAction(actionWatchFile);
+        menuFile->addAction(actionWatchDirectory);
+        menuFile->addSeparator();
         menuFile->addAction(actionExit);
         menuTool->addAction(actionRun);
         menuTool->addAction(actionStop);
+        menuTool->addAction(actionSimulationThread);
         menuTool->addSeparator();
         menuTool->addAction(actionPhaseControl);
         menuOptions->addAction(actionShowAll);
@@ -108,6 +128,8 @@ public:
         menuOptions->addAction(actionShowAssemblies);
         menuOptions->addAction(actionShowLinks);
         menuOptions->addAction(actionShowBodies);
+        menuOptions->addSeparator();
+        menuOptions->addAction(actionFadeTraces);
 
         retranslateUi(MainWindowClass);
 
@@ -124,11 +146,15 @@ public:
         actionShowAll->setText(QApplication::translate("MainWindowClass", "Show All", 0));
         actionShowLinks->setText(QApplication::translate("MainWindowClass", "Show Links", 0));
         actionShowBodies->setText(QApplication::translate("MainWindowClass", "Show Bodies", 0));
+        actionFadeTraces->setText(QApplication::translate("MainWindowClass", "Fade Traces", 0));
         actionOpen->setText(QApplication::translate("MainWindowClass", "Open", 0));
         actionOpen->setShortcut(QApplication::translate("MainWindowClass", "Ctrl+O", 0));
         actionSave->setText(QApplication::translate("MainWindowClass", "Save", 0));
         actionSave->setShortcut(QApplication::translate("MainWindowClass", "Ctrl+S", 0));
+        actionSimulationThread->setText(QApplication::translate("MainWindowClass", "Simulate in Separate Thread", 0));
         actionPhaseControl->setText(QApplication::translate("MainWindowClass", "Phase Control", 0));
+        actionWatchFile->setText(QApplication::translate("MainWindowClass", "Reload on Change", 0));
+        actionWatchDirectory->setText(QApplication::translate("MainWindowClass", "Watch Design Directory", 0));
         menuFile->setTitle(QApplication::translate("MainWindowClass", "File", 0));
         menuTool->setTitle(QApplication::translate("MainWindowClass", "Tool", 0));
         menuOptions->setTitle(QApplication::translate("MainWindowClass", "Options", 0));
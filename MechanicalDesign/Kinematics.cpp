@@ -1,119 +1,519 @@
 #include "Kinematics.h"
+#include "KinematicsSolver.h"
+#include "Geometry.h"
 #include <iostream>
+#include <algorithm>
+#include <cstring>
 #include <QFile>
-#include <QDomDocument>
-#include <QTextStream>
+#include <QFileInfo>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
 #include <QDate>
 
 namespace kinematics {
 	float M_PI = 3.141592653;
 
-	glm::vec2 circleCircleIntersection(const glm::vec2& center1, float radius1, const glm::vec2& center2, float radius2) {
-		glm::vec2 dir = center2 - center1;
-		float d = glm::length(dir);
-		if (d > radius1 + radius2) {
-			throw "No intersection";
+	// number of the latest end-effector positions shown as a trace
+	const int TRACE_LENGTH = 240;
+
+	// nominal time step, and the longest period that is cached
+	const float DEFAULT_TIME_STEP = 0.03;
+	const int MAX_CACHED_FRAMES = 4096;
+
+	// number of gear radii whose outlines are kept
+	const int MAX_GEAR_OUTLINES = 64;
+
+	// a period is exact if the phases come back to within this fraction of the phase travelled in it
+	const double PERIOD_TOLERANCE = 1e-6;
+
+	// pens and brushes, created once so that painting a frame does not allocate them
+	const QPen GEAR_PEN(QColor(255, 0, 0), 1);
+	const QPen ASSEMBLY_PEN(QColor(0, 0, 255), 3);
+	const QPen TRACE_PEN(QColor(255, 0, 0), 1);
+	const QPen BODY_PEN(QColor(0, 0, 0), 1);
+	const QPen LINK_PEN(QColor(0, 0, 0), 3);
+	const QBrush BODY_BRUSH(QColor(0, 255, 0, 60));
+	const QBrush JOINT_BRUSH(QColor(255, 255, 255));
+
+	// fixed-point phase units per turn and per radian
+	const double PHASE_UNITS_PER_TURN = 18446744073709551616.0;
+	const double PHASE_UNITS_PER_RADIAN = PHASE_UNITS_PER_TURN / (3.14159265358979323846 * 2);
+
+	/**
+	 * Convert an angle in radians into fixed-point phase units, modulo one turn.
+	 * A negative angle is negated in the fixed point, so that small backward steps
+	 * are as precise as the forward ones.
+	 */
+	unsigned long long toPhaseUnits(double radians) {
+		if (radians < 0) return 0 - toPhaseUnits(-radians);
+
+		double turns = radians / (3.14159265358979323846 * 2);
+		return (unsigned long long)((turns - floor(turns)) * PHASE_UNITS_PER_TURN);
+	}
+
+	/**
+	 * Binary design file (*.mdb).
+	 * A header is followed by a payload of the arrays below in this order, all of
+	 * whose fields are 4-byte little-endian values. The checksum is the 32-bit FNV-1a
+	 * hash of the payload. Point indices are dense indices, not ids.
+	 *   point ids, x, y          int[num_points], float[num_points], float[num_points]
+	 *   links                    BinaryLink[num_links]
+	 *   assemblies               BinaryAssembly[num_assemblies]
+	 *   gears                    BinaryGear[num_gears]
+	 *   assembly link lengths    float[num_lengths]
+	 *   bodies                   BinaryBody[num_bodies]
+	 *   body points              float[num_body_points * 2]
+	 *   solve schedule           BinarySolveStep[num_solve_steps]
+	 */
+	const char BINARY_MAGIC[4] = { 'M', 'D', 'S', 'N' };
+	const unsigned int BINARY_VERSION = 1;
+
+	struct BinaryHeader {
+		char magic[4];
+		unsigned int version;
+		unsigned int checksum;
+		unsigned int payload_size;
+		int num_points;
+		int num_links;
+		int num_assemblies;
+		int num_gears;
+		int num_lengths;
+		int num_bodies;
+		int num_body_points;
+		int num_solve_steps;
+	};
+
+	struct BinaryLink {
+		int start;
+		int end;
+		int order;
+		float length;
+	};
+
+	struct BinaryAssembly {
+		float phase;
+		int end_effector;
+		int order1;
+		int order2;
+		int first_gear;
+		int num_gears;
+		int first_length;
+		int num_lengths;
+	};
+
+	struct BinaryGear {
+		float x;
+		float y;
+		float radius;
+		float phase;
+		float speed;
+	};
+
+	struct BinaryBody {
+		int pivot1;
+		int pivot2;
+		int first_point;
+		int num_points;
+	};
+
+	struct BinarySolveStep {
+		int point;
+		int parent1;
+		int parent2;
+		int link1;
+		int link2;
+	};
+
+	unsigned int fnv1a(const unsigned char* data, size_t size) {
+		unsigned int hash = 2166136261u;
+		for (size_t i = 0; i < size; ++i) {
+			hash ^= data[i];
+			hash *= 16777619u;
+		}
+		return hash;
+	}
+
+	/**
+	 * 64-bit FNV-1a hash accumulated value by value, for the content hash of a design.
+	 */
+	class DesignHasher {
+	public:
+		unsigned long long hash;
+
+	public:
+		DesignHasher() : hash(14695981039346656037ull) {}
+
+		void add(const void* data, size_t size) {
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+			for (size_t i = 0; i < size; ++i) {
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+		}
+		void add(int value) { add(&value, sizeof(value)); }
+		void add(float value) {
+			// -0 and +0 are the same value
+			if (value == 0) value = 0;
+			add(&value, sizeof(value));
 		}
-		/*if (d > radius1 + radius2) {
-			return (center1 * radius2 + center2 + radius1) / (radius1 + radius2);
-		}*/
+		void add(const glm::vec2& v) { add(v.x); add(v.y); }
+	};
 
-		float a = (radius1 * radius1 - radius2 * radius2 + d * d) / d / 2.0f;
-		float h = sqrtf(radius1 * radius1 - a * a);
+	/**
+	 * Return a pointer to the next n elements of type T of the mapped payload.
+	 */
+	template<typename T>
+	const T* takeArray(const unsigned char*& ptr, const unsigned char* end, int n) {
+		if (n < 0 || (size_t)(end - ptr) < sizeof(T) * n) throw "Invalid file format.";
+		const T* ret = reinterpret_cast<const T*>(ptr);
+		ptr += sizeof(T) * n;
+		return ret;
+	}
 
-		glm::vec2 perp(-dir.y, dir.x);
-		perp /= glm::length(perp);
+	template<typename T>
+	void appendArray(std::vector<unsigned char>& buffer, const T* data, int n) {
+		if (n == 0) return;
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+		buffer.insert(buffer.end(), bytes, bytes + sizeof(T) * n);
+	}
 
-		return center1 + dir * a / d + perp * h;
+	QString SolveStatus::message() const {
+		switch (code) {
+		case OK:
+			return "OK";
+		case ASSEMBLY_FAILED:
+			return QString("Assembly %1 cannot be assembled at phase %2.").arg(assembly).arg(phase);
+		default:
+			return QString("No intersection at point %1 (links %2 and %3) at phase %4.").arg(point).arg(link1).arg(link2).arg(phase);
+		}
 	}
 
-	Link::Link(int start, int end, float length) {
+	Link::Link(int start, int end, int order, float length) {
 		this->start = start;
 		this->end = end;
+		this->order = order;
 		this->length = length;
 	}
 
-	glm::vec2 Gear::getLinkEndPosition() {
-		return center + glm::vec2(cos(phase), sin(phase)) * radius;
+	void PointStore::clear() {
+		ids.clear();
+		x.clear();
+		y.clear();
+		index_of.clear();
+		in_offsets.clear();
+		in_links.clear();
+		out_offsets.clear();
+		out_links.clear();
 	}
 
 	/**
-	 * Draw a gear.
+	 * Add a point and return its dense index.
 	 */
-	void Gear::draw(QPainter& painter) {
-		painter.setPen(QPen(QColor(255, 0, 0), 1));
+	int PointStore::add(int id, const glm::vec2& pos) {
+		if (id < 0) throw "Invalid point id.";
+
+		// a point that is defined twice overwrites the previous one
+		std::unordered_map<int, int>::iterator it = index_of.find(id);
+		if (it != index_of.end()) {
+			setPos(it->second, pos);
+			return it->second;
+		}
 
-		painter.drawEllipse(QPoint(center.x, center.y), 4, 4);
+		int index = ids.size();
+		index_of[id] = index;
+		ids.push_back(id);
+		x.push_back(pos.x);
+		y.push_back(pos.y);
 
+		return index;
+	}
+
+	int PointStore::indexOf(int id) const {
+		std::unordered_map<int, int>::const_iterator it = index_of.find(id);
+		if (it == index_of.end()) return -1;
+		return it->second;
+	}
+
+	/**
+	 * Build the CSR adjacency from the links, whose start/end are dense indices.
+	 * The incoming links of each point are ordered by their order attribute, and a
+	 * slot that no link fills is set to -1.
+	 */
+	void PointStore::buildAdjacency(const std::vector<Link>& links) {
+		in_offsets.assign(size() + 1, 0);
+		out_offsets.assign(size() + 1, 0);
+		for (int i = 0; i < links.size(); ++i) {
+			in_offsets[links[i].end + 1] = std::max(in_offsets[links[i].end + 1], links[i].order + 1);
+			out_offsets[links[i].start + 1]++;
+		}
+		for (int i = 0; i < size(); ++i) {
+			in_offsets[i + 1] += in_offsets[i];
+			out_offsets[i + 1] += out_offsets[i];
+		}
+
+		in_links.assign(in_offsets.back(), -1);
+		out_links.assign(out_offsets.back(), -1);
+		std::vector<int> num_out(size(), 0);
+		for (int i = 0; i < links.size(); ++i) {
+			in_links[in_offsets[links[i].end] + links[i].order] = i;
+			out_links[out_offsets[links[i].start] + num_out[links[i].start]++] = i;
+		}
+	}
+
+	/**
+	 * Set the phase, wrapped into one turn, and compute its rotor exactly.
+	 */
+	void PhaseClock::set(float radians) {
+		angle = toPhaseUnits(radians);
+		double a = angle / PHASE_UNITS_PER_RADIAN;
+		rotor = glm::dvec2(cos(a), sin(a));
+	}
+
+	/**
+	 * Advance the phase by the given angle, rounded to the fixed point. The rotor
+	 * is rotated by the rotor of the step, and computed exactly again whenever the
+	 * phase wraps, so that its rounding errors do not build up over the turns.
+	 */
+	void PhaseClock::advance(double radians) {
+		if (radians != step) {
+			step = radians;
+			step_angle = toPhaseUnits(radians);
+			double a = step_angle / PHASE_UNITS_PER_RADIAN;
+			step_rotor = glm::dvec2(cos(a), sin(a));
+		}
+
+		unsigned long long next = angle + step_angle;
+		bool wrapped = (long long)step_angle >= 0 ? next < angle : next > angle;
+		angle = next;
+
+		if (wrapped) {
+			double a = angle / PHASE_UNITS_PER_RADIAN;
+			rotor = glm::dvec2(cos(a), sin(a));
+		}
+		else {
+			rotor = glm::dvec2(rotor.x * step_rotor.x - rotor.y * step_rotor.y, rotor.x * step_rotor.y + rotor.y * step_rotor.x);
+		}
+	}
+
+	/**
+	 * Return the phase in [0, 2pi].
+	 */
+	float PhaseClock::radians() const {
+		return angle / PHASE_UNITS_PER_RADIAN;
+	}
+
+	Gear::Gear(const glm::vec2& center, float radius, float phase, float speed) : center(center), radius(radius), speed(speed) {
+		clock.set(phase);
+		this->phase = clock.radians();
+	}
+
+	void Gear::setClock(const PhaseClock& clock) {
+		this->clock = clock;
+		phase = clock.radians();
+	}
+
+	void Gear::advance(float time_step) {
+		clock.advance((double)speed * time_step);
+		phase = clock.radians();
+	}
+
+	glm::vec2 Gear::getLinkEndPosition() const {
+		glm::vec2 pos;
+		linkEndPosition(center.x, center.y, radius, (float)clock.rotor.x, (float)clock.rotor.y, pos.x, pos.y);
+		return pos;
+	}
+
+	/**
+	 * Return the tooth outline of a gear of the given radius, centered at the origin
+	 * with phase 0. The outlines are built once per radius rounded to a tenth of a
+	 * pixel, and they are all dropped once there are too many, since dragging a gear
+	 * resizes it continuously.
+	 */
+	const QPainterPath& GearOutlineCache::get(float radius) {
+		int key = radius * 10 + 0.5f;
+		std::map<int, QPainterPath>::const_iterator it = outlines.find(key);
+		if (it != outlines.end()) return it->second;
+
+		if (outlines.size() >= MAX_GEAR_OUTLINES) outlines.clear();
+
+		QPainterPath& path = outlines[key];
+		radius = key * 0.1f;
 		int num_split = radius * 0.4;
 		for (int i = 0; i < num_split; ++i) {
 			float theta1 = i * M_PI * 2.0 / num_split;
 			float theta2 = (i + 0.5) * M_PI * 2.0 / num_split;
 			float theta3 = (i + 1) * M_PI * 2.0 / num_split;
 
-			glm::vec2 p1 = center + glm::vec2(cos(phase + theta1), sin(phase + theta1)) * (radius + 5);
-			glm::vec2 p2 = center + glm::vec2(cos(phase + theta2), sin(phase + theta2)) * (radius + 5);
-			glm::vec2 p3 = center + glm::vec2(cos(phase + theta2), sin(phase + theta2)) * radius;
-			glm::vec2 p4 = center + glm::vec2(cos(phase + theta3), sin(phase + theta3)) * radius;
-			glm::vec2 p5 = center + glm::vec2(cos(phase + theta3), sin(phase + theta3)) * (radius + 5);
-
-			painter.drawLine(p1.x, p1.y, p2.x, p2.y);
-			painter.drawLine(p2.x, p2.y, p3.x, p3.y);
-			painter.drawLine(p3.x, p3.y, p4.x, p4.y);
-			painter.drawLine(p4.x, p4.y, p5.x, p5.y);
+			if (i == 0) path.moveTo(cos(theta1) * (radius + 5), sin(theta1) * (radius + 5));
+			path.lineTo(cos(theta2) * (radius + 5), sin(theta2) * (radius + 5));
+			path.lineTo(cos(theta2) * radius, sin(theta2) * radius);
+			path.lineTo(cos(theta3) * radius, sin(theta3) * radius);
+			path.lineTo(cos(theta3) * (radius + 5), sin(theta3) * (radius + 5));
 		}
+		if (num_split > 0) path.closeSubpath();
+
+		return path;
 	}
 
-	glm::vec2 MechanicalAssembly::getIntermediateJointPosition() {
-		glm::vec2 p1 = gears[order.first].getLinkEndPosition();
-		glm::vec2 p2 = gears[order.second].getLinkEndPosition();
+	/**
+	 * Draw a gear.
+	 */
+	void Gear::draw(QPainter& painter, GearOutlineCache& outlines) {
+		painter.setPen(GEAR_PEN);
+
+		painter.drawEllipse(QPoint(center.x, center.y), 4, 4);
+
+		// the teeth are rotated by the phase instead of being recomputed, and only the
+		// transform is restored, since save() allocates a painter state
+		QTransform transform = painter.worldTransform();
+		painter.setBrush(Qt::NoBrush);
+		painter.translate(center.x, center.y);
+		painter.rotate(phase * 180.0 / M_PI);
+		painter.drawPath(outlines.get(radius));
+		painter.setWorldTransform(transform);
+	}
+
+	/**
+	 * Return the configuration for the current phases. It is solved only once per
+	 * generation, and all the getters and the drawing read it from the cache.
+	 */
+	const AssemblyState& MechanicalAssembly::getState() const {
+		if (state.generation == generation) return state;
+
+		state.generation = generation;
+		state.link_ends.resize(gears.size());
+		for (int i = 0; i < gears.size(); ++i) {
+			state.link_ends[i] = gears[i].getLinkEndPosition();
+		}
 
-		return circleCircleIntersection(p1, link_lengths[order.first], p2, link_lengths[order.second]);
+		const glm::vec2& p0 = state.link_ends[0];
+		const glm::vec2& p1 = state.link_ends[order.first];
+		const glm::vec2& p2 = state.link_ends[order.second];
+		state.assembled = assemblyPositions(p0.x, p0.y, p1.x, p1.y, link_lengths[order.first], p2.x, p2.y, link_lengths[order.second], link_lengths[0], link_lengths[2], state.joint.x, state.joint.y, state.end_effector.x, state.end_effector.y);
+
+		return state;
+	}
+
+	/**
+	 * Compute the joint of the two links driven by the gears. Returns false if the
+	 * links cannot be connected at the current phase.
+	 */
+	bool MechanicalAssembly::getIntermediateJointPosition(glm::vec2& joint) const {
+		const AssemblyState& s = getState();
+		joint = s.joint;
+		return s.assembled;
 	}
 
-	glm::vec2 MechanicalAssembly::getEndEffectorPosition() {
-		glm::vec2 p1 = gears[order.first].getLinkEndPosition();
-		glm::vec2 p2 = gears[order.second].getLinkEndPosition();
+	bool MechanicalAssembly::getEndEffectorPosition(glm::vec2& pos) const {
+		const AssemblyState& s = getState();
+		pos = s.end_effector;
+		return s.assembled;
+	}
 
-		glm::vec2 joint = circleCircleIntersection(p1, link_lengths[order.first], p2, link_lengths[order.second]);
-		glm::vec2 dir = joint - gears[0].getLinkEndPosition();
+	void MechanicalAssembly::setPhase(float phase) {
+		invalidate();
+		clock.set(phase);
+		this->phase = clock.radians();
+	}
 
-		return gears[0].getLinkEndPosition() + dir / link_lengths[0] * (link_lengths[0] + link_lengths[2]);
+	void MechanicalAssembly::setClock(const PhaseClock& clock) {
+		invalidate();
+		this->clock = clock;
+		phase = clock.radians();
 	}
 
 	void MechanicalAssembly::forward(float time_step) {
-		phase += time_step;
-		if (phase > M_PI * 2) phase -= M_PI * 2;
-		if (phase < 0) phase += M_PI * 2;
+		invalidate();
+
+		clock.advance(time_step);
+		phase = clock.radians();
 
 		for (int i = 0; i < gears.size(); ++i) {
-			gears[i].phase += gears[i].speed * time_step;
-			if (gears[i].phase > M_PI * 2) gears[i].phase -= M_PI * 2;
-			if (gears[i].phase < 0) gears[i].phase += M_PI * 2;
+			gears[i].advance(time_step);
 		}
-				
-		end_effector->pos = getEndEffectorPosition();
 	}
 
-	void MechanicalAssembly::draw(QPainter& painter) {
-		glm::vec2 p1 = gears[0].getLinkEndPosition();
-		glm::vec2 p2 = gears[1].getLinkEndPosition();
-		glm::vec2 intP = getIntermediateJointPosition();
-		glm::vec2 endP = getEndEffectorPosition();
+	/**
+	 * Compute the end-effector positions of the next num_samples steps (including the
+	 * current one) without changing the state. The dyads are solved in batches of 8
+	 * time samples. Returns false if the assembly cannot be assembled at some sample.
+	 */
+	bool MechanicalAssembly::sampleEndEffectorPositions(float time_step, int num_samples, std::vector<glm::vec2>& positions) const {
+		const Gear& g0 = gears[0];
+		const Gear& g1 = gears[order.first];
+		const Gear& g2 = gears[order.second];
+
+		// the clocks are advanced in the same way as the gears are stepped, so that the samples match the steps
+		PhaseClock c0 = g0.clock;
+		PhaseClock c1 = g1.clock;
+		PhaseClock c2 = g2.clock;
+
+		float x0[8], y0[8], x1[8], y1[8], r1[8], x2[8], y2[8], r2[8], side[8], x[8], y[8];
+		for (int k = 0; k < 8; ++k) {
+			r1[k] = link_lengths[order.first];
+			r2[k] = link_lengths[order.second];
+			side[k] = geometry::CCW;
+		}
+
+		positions.resize(num_samples);
+		for (int i = 0; i < num_samples; i += 8) {
+			int n = std::min(8, num_samples - i);
+			for (int k = 0; k < 8; ++k) {
+				// the unused lanes repeat the last sample
+				if (k > 0 && k >= n) {
+					x0[k] = x0[k - 1]; y0[k] = y0[k - 1];
+					x1[k] = x1[k - 1]; y1[k] = y1[k - 1];
+					x2[k] = x2[k - 1]; y2[k] = y2[k - 1];
+					continue;
+				}
+
+				glm::vec2 p0 = g0.center + glm::vec2(c0.rotor) * g0.radius;
+				glm::vec2 p1 = g1.center + glm::vec2(c1.rotor) * g1.radius;
+				glm::vec2 p2 = g2.center + glm::vec2(c2.rotor) * g2.radius;
+				x0[k] = p0.x; y0[k] = p0.y;
+				x1[k] = p1.x; y1[k] = p1.y;
+				x2[k] = p2.x; y2[k] = p2.y;
+
+				c0.advance((double)g0.speed * time_step);
+				c1.advance((double)g1.speed * time_step);
+				c2.advance((double)g2.speed * time_step);
+			}
+
+			if (geometry::circleCircleIntersection8(x1, y1, r1, x2, y2, r2, side, x, y) & ((1 << n) - 1)) return false;
+
+			for (int k = 0; k < n; ++k) {
+				glm::vec2 p0(x0[k], y0[k]);
+				glm::vec2 dir = glm::vec2(x[k], y[k]) - p0;
+				positions[i + k] = p0 + dir / link_lengths[0] * (link_lengths[0] + link_lengths[2]);
+			}
+		}
+
+		return true;
+	}
+
+	void MechanicalAssembly::draw(QPainter& painter, GearOutlineCache& outlines) {
+		const AssemblyState& s = getState();
+		glm::vec2 p1 = s.link_ends[0];
+		glm::vec2 p2 = s.link_ends[1];
+		glm::vec2 intP = s.joint;
+		glm::vec2 endP = s.end_effector;
 
 		// draw gears
 		for (int i = 0; i < gears.size(); ++i) {
-			gears[i].draw(painter);
+			gears[i].draw(painter, outlines);
 		}
 
+		// the links are not drawn when they cannot be connected
+		if (!s.assembled) return;
+
 		// draw links
-		painter.setPen(QPen(QColor(0, 0, 255), 3));
-		painter.setBrush(QBrush(QColor(255, 255, 255)));
+		painter.setPen(ASSEMBLY_PEN);
+		painter.setBrush(JOINT_BRUSH);
 		painter.drawLine(p1.x, p1.y, endP.x, endP.y);
 		painter.drawLine(p2.x, p2.y, intP.x, intP.y);
 
 		// draw joints
-		painter.setPen(QPen(QColor(0, 0, 255), 3));
+		painter.setPen(ASSEMBLY_PEN);
 		painter.drawEllipse(QPoint(p1.x, p1.y), 3, 3);
 		painter.drawEllipse(QPoint(p2.x, p2.y), 3, 3);
 		painter.drawEllipse(QPoint(intP.x, intP.y), 3, 3);
@@ -121,369 +521,1203 @@ namespace kinematics {
 	}
 
 	Kinematics::Kinematics() {
+		time_step = DEFAULT_TIME_STEP;
+		frame = 0;
+		revision = 0;
 		show_assemblies = true;
 		show_links = true;
 		show_bodies = true;
 	}
 
+	/**
+	 * Load a design. Files with the .mdb extension are read as binary designs.
+	 * The XML is parsed in a single pass. A malformed file throws a QString with
+	 * the line and column of the error.
+	 */
 	void Kinematics::load(const QString& filename) {
+		if (QFileInfo(filename).suffix().toLower() == "mdb") {
+			loadBinary(filename);
+			return;
+		}
+
 		QFile file(filename);
 		if (!file.open(QFile::ReadOnly | QFile::Text)) throw "Fild cannot open.";
 
-		QDomDocument doc;
-		doc.setContent(&file);
-
-		QDomElement root = doc.documentElement();
-		if (root.tagName() != "design")	throw "Invalid file format.";
-
-		// clear the data
-		points.clear();
-		assemblies.clear();
-		links.clear();
-		bodies.clear();
-		trace_end_effector.clear();
-
-		QDomNode node = root.firstChild();
-		while (!node.isNull()) {
-			if (node.toElement().tagName() == "points") {
-				QDomNode point_node = node.firstChild();
-				while (!point_node.isNull()) {
-					if (point_node.toElement().tagName() == "point") {
+		// parse into a new design, so that this one is left as it is if the file is rejected
+		Kinematics design;
+
+		QXmlStreamReader xml(&file);
+		if (!xml.readNextStartElement() || xml.name() != "design") {
+			if (!xml.hasError()) xml.raiseError("Invalid file format.");
+		}
+
+		while (!xml.hasError() && xml.readNextStartElement()) {
+			if (xml.name() == "points") {
+				while (xml.readNextStartElement()) {
+					if (xml.name() == "point") {
 						// add a point
-						int id = point_node.toElement().attribute("id").toInt();
-						float x = point_node.toElement().attribute("x").toFloat();
-						float y = point_node.toElement().attribute("y").toFloat();
-						points[id] = boost::shared_ptr<Point>(new Point(id, glm::vec2(x, y)));
+						QXmlStreamAttributes attrs = xml.attributes();
+						int id = attrs.value("id").toInt();
+						float x = attrs.value("x").toFloat();
+						float y = attrs.value("y").toFloat();
+						if (id < 0) {
+							xml.raiseError("Invalid point id.");
+							break;
+						}
+						design.points.add(id, glm::vec2(x, y));
 					}
-
-					point_node = point_node.nextSibling();
+					xml.skipCurrentElement();
 				}
 			}
-			else if (node.toElement().tagName() == "assemblies") {
-				QDomNode assembly_node = node.firstChild();
-				while (!assembly_node.isNull()) {
-					if (assembly_node.toElement().tagName() == "assembly") {
-						// add an assembly
-						boost::shared_ptr<MechanicalAssembly> ass = boost::shared_ptr<MechanicalAssembly>(new MechanicalAssembly());
-
-						int end_effector_id = assembly_node.toElement().attribute("end_effector").toInt();
-						ass->end_effector = points[end_effector_id];
-
-						QDomNode assembly_part_node = assembly_node.firstChild();
-						while (!assembly_part_node.isNull()) {
-							if (assembly_part_node.toElement().tagName() == "gear") {
-								float x = assembly_part_node.toElement().attribute("x").toFloat();
-								float y = assembly_part_node.toElement().attribute("y").toFloat();
-								float radius = assembly_part_node.toElement().attribute("radius").toFloat();
-								float phase = assembly_part_node.toElement().attribute("phase").toFloat();
-								float speed = assembly_part_node.toElement().attribute("speed").toFloat();
-
-								ass->gears.push_back(Gear(glm::vec2(x, y), radius, phase, speed));
-							}
-							else if (assembly_part_node.toElement().tagName() == "order") {
-								int id1 = assembly_part_node.toElement().attribute("id1").toInt();
-								int id2 = assembly_part_node.toElement().attribute("id2").toInt();
-								ass->order = std::make_pair(id1, id2);
-							}
-							else if (assembly_part_node.toElement().tagName() == "link") {
-								float length = assembly_part_node.toElement().attribute("length").toFloat();
-								ass->link_lengths.push_back(length);
-							}
-
-							assembly_part_node = assembly_part_node.nextSibling();
+			else if (xml.name() == "assemblies") {
+				while (xml.readNextStartElement()) {
+					if (xml.name() != "assembly") {
+						xml.skipCurrentElement();
+						continue;
+					}
+
+					// add an assembly
+					boost::shared_ptr<MechanicalAssembly> ass = boost::shared_ptr<MechanicalAssembly>(new MechanicalAssembly());
+
+					int end_effector_id = xml.attributes().value("end_effector").toInt();
+					ass->end_effector = design.points.indexOf(end_effector_id);
+					if (ass->end_effector < 0) {
+						xml.raiseError("Invalid point id.");
+						break;
+					}
+
+					while (xml.readNextStartElement()) {
+						QXmlStreamAttributes attrs = xml.attributes();
+						if (xml.name() == "gear") {
+							float x = attrs.value("x").toFloat();
+							float y = attrs.value("y").toFloat();
+							float radius = attrs.value("radius").toFloat();
+							float phase = attrs.value("phase").toFloat();
+							float speed = attrs.value("speed").toFloat();
+
+							ass->gears.push_back(Gear(glm::vec2(x, y), radius, phase, speed));
+						}
+						else if (xml.name() == "order") {
+							int id1 = attrs.value("id1").toInt();
+							int id2 = attrs.value("id2").toInt();
+							ass->order = std::make_pair(id1, id2);
+						}
+						else if (xml.name() == "link") {
+							float length = attrs.value("length").toFloat();
+							ass->link_lengths.push_back(length);
 						}
+						xml.skipCurrentElement();
+					}
+					if (xml.hasError()) break;
 
-						ass->end_effector->pos = ass->getEndEffectorPosition();
-						assemblies.push_back(ass);
+					int num_driven = std::min(ass->gears.size(), ass->link_lengths.size());
+					if (ass->link_lengths.size() < 3 || ass->order.first < 0 || ass->order.first >= num_driven || ass->order.second < 0 || ass->order.second >= num_driven) {
+						xml.raiseError("Invalid assembly.");
+						break;
 					}
 
-					assembly_node = assembly_node.nextSibling();
+					glm::vec2 pos;
+					if (!ass->getEndEffectorPosition(pos)) {
+						xml.raiseError("No intersection.");
+						break;
+					}
+					design.points.setPos(ass->end_effector, pos);
+					design.assemblies.push_back(ass);
 				}
 			}
-			else if (node.toElement().tagName() == "links") {
-				QDomNode link_node = node.firstChild();
-				while (!link_node.isNull()) {
-					if (link_node.toElement().tagName() == "link") {
+			else if (xml.name() == "links") {
+				while (xml.readNextStartElement()) {
+					if (xml.name() == "link") {
 						// add a link
-						int order = link_node.toElement().attribute("order").toInt();
-						int start = link_node.toElement().attribute("start").toInt();
-						int end = link_node.toElement().attribute("end").toInt();
-						boost::shared_ptr<Link> link = boost::shared_ptr<Link>(new Link(start, end, glm::length(points[start]->pos - points[end]->pos)));
-						links.push_back(link);
-
-						// set outgoing link to the point
-						points[start]->out_links.push_back(link);
-
-						// set incoming link to the point
-						if (points[end]->in_links.size() < order + 1) points[end]->in_links.resize(order + 1);
-						points[end]->in_links[order] = link;
+						QXmlStreamAttributes attrs = xml.attributes();
+						int order = attrs.value("order").toInt();
+						int start = design.points.indexOf(attrs.value("start").toInt());
+						int end = design.points.indexOf(attrs.value("end").toInt());
+						if (start < 0 || end < 0) {
+							xml.raiseError("Invalid point id.");
+							break;
+						}
+						if (order < 0) {
+							xml.raiseError("Invalid link order.");
+							break;
+						}
+						design.links.push_back(Link(start, end, order, glm::length(design.points.pos(start) - design.points.pos(end))));
 					}
-
-					link_node = link_node.nextSibling();
+					xml.skipCurrentElement();
 				}
 			}
-			else if (node.toElement().tagName() == "bodies") {
-				QDomNode body_node = node.firstChild();
-				while (!body_node.isNull()) {
-					if (body_node.toElement().tagName() == "body") {
-						// add a body
-						int id1 = body_node.toElement().attribute("id1").toInt();
-						int id2 = body_node.toElement().attribute("id2").toInt();
-						Part part(id1, id2);
-
-						// setup rotation matrix
-						glm::vec2 dir = points[id2]->pos - points[id1]->pos;
-						float angle = atan2f(dir.y, dir.x);
-						glm::vec2 p1 = (points[id1]->pos + points[id2]->pos) * 0.5f;
-						glm::mat4x4 model;
-						model = glm::rotate(model, -angle, glm::vec3(0, 0, 1));						
-												
-						QDomNode point_node = body_node.firstChild();
-						while (!point_node.isNull()) {
-							if (point_node.toElement().tagName() == "point") {
-								float x = point_node.toElement().attribute("x").toFloat();
-								float y = point_node.toElement().attribute("y").toFloat();
-
-								// convert the coordinates to the local coordinate system
-								glm::vec2 rotated_p = glm::vec2(model * glm::vec4(x - p1.x, y - p1.y, 0, 1));
-								
-								part.points.push_back(rotated_p);
-							}
-
-							point_node = point_node.nextSibling();
-						}
+			else if (xml.name() == "bodies") {
+				while (xml.readNextStartElement()) {
+					if (xml.name() != "body") {
+						xml.skipCurrentElement();
+						continue;
+					}
+
+					// add a body
+					int id1 = design.points.indexOf(xml.attributes().value("id1").toInt());
+					int id2 = design.points.indexOf(xml.attributes().value("id2").toInt());
+					if (id1 < 0 || id2 < 0) {
+						xml.raiseError("Invalid point id.");
+						break;
+					}
+					Part part(id1, id2);
+
+					// setup rotation matrix
+					glm::vec2 dir = design.points.pos(id2) - design.points.pos(id1);
+					float angle = atan2f(dir.y, dir.x);
+					glm::vec2 p1 = (design.points.pos(id1) + design.points.pos(id2)) * 0.5f;
+					glm::mat4x4 model;
+					model = glm::rotate(model, -angle, glm::vec3(0, 0, 1));
+
+					while (xml.readNextStartElement()) {
+						if (xml.name() == "point") {
+							float x = xml.attributes().value("x").toFloat();
+							float y = xml.attributes().value("y").toFloat();
+
+							// convert the coordinates to the local coordinate system
+							glm::vec2 rotated_p = glm::vec2(model * glm::vec4(x - p1.x, y - p1.y, 0, 1));
 
-						bodies.push_back(part);
+							part.points.push_back(rotated_p);
+						}
+						xml.skipCurrentElement();
 					}
+					if (xml.hasError()) break;
 
-					body_node = body_node.nextSibling();
+					design.bodies.push_back(part);
 				}
 			}
+			else {
+				xml.skipCurrentElement();
+			}
+		}
 
-			node = node.nextSibling();
+		// read to the end so that trailing garbage is reported, too
+		while (!xml.atEnd()) xml.readNext();
+
+		if (xml.hasError()) {
+			throw QString("line %1, column %2: %3").arg(xml.lineNumber()).arg(xml.columnNumber()).arg(xml.errorString());
 		}
 
-		trace_end_effector.resize(assemblies.size());
+		design.points.buildAdjacency(design.links);
+		design.compile();
+		replaceDesign(design);
 	}
 
+	/**
+	 * Take over the points, links, assemblies, bodies and solve schedule of a design
+	 * that has been loaded and compiled, and start its cycle from its phases. The
+	 * display settings are kept.
+	 */
+	void Kinematics::replaceDesign(Kinematics& design) {
+		std::swap(points, design.points);
+		links.swap(design.links);
+		assemblies.swap(design.assemblies);
+		bodies.swap(design.bodies);
+		solve_schedule.swap(design.solve_schedule);
+		trace_end_effector.assign(assemblies.size(), RingBuffer<glm::vec2>(TRACE_LENGTH));
+
+		indexSolveSchedule();
+		keepInitialPhases();
+		invalidateFrameCache();
+	}
+
+	/**
+	 * Save the design. Files with the .mdb extension are written as binary designs.
+	 */
 	void Kinematics::save(const QString& filename) {
+		if (QFileInfo(filename).suffix().toLower() == "mdb") {
+			saveBinary(filename);
+			return;
+		}
+
 		QFile file(filename);
-		if (!file.open(QFile::WriteOnly)) throw "File cannot open.";
+		if (!file.open(QFile::WriteOnly | QFile::Text)) throw "File cannot open.";
 
-		QDomDocument doc;
+		QXmlStreamWriter xml(&file);
+		xml.setAutoFormatting(true);
+		xml.setAutoFormattingIndent(4);
+		xml.writeStartDocument();
 
 		// set root node
-		QDomElement root = doc.createElement("design");
-		root.setAttribute("author", "Gen Nishida");
-		root.setAttribute("version", "1.0");
-		root.setAttribute("date", QDate::currentDate().toString("MM/dd/yyyy"));
-		doc.appendChild(root);
+		xml.writeStartElement("design");
+		xml.writeAttribute("author", "Gen Nishida");
+		xml.writeAttribute("version", "1.0");
+		xml.writeAttribute("date", QDate::currentDate().toString("MM/dd/yyyy"));
 
 		// write points
-		QDomElement points_node = doc.createElement("points");
-		root.appendChild(points_node);
-		for (auto it = points.begin(); it != points.end(); ++it) {
-			QDomElement point_node = doc.createElement("point");
-			point_node.setAttribute("id", it.key());
-			point_node.setAttribute("x", it.value()->pos.x);
-			point_node.setAttribute("y", it.value()->pos.y);
-			points_node.appendChild(point_node);
+		xml.writeStartElement("points");
+		for (int i = 0; i < points.size(); ++i) {
+			xml.writeStartElement("point");
+			xml.writeAttribute("id", QString::number(points.ids[i]));
+			xml.writeAttribute("x", QString::number(points.x[i]));
+			xml.writeAttribute("y", QString::number(points.y[i]));
+			xml.writeEndElement();
 		}
+		xml.writeEndElement();
 
 		// write assemblies
-		QDomElement assemblies_node = doc.createElement("assemblies");
-		root.appendChild(assemblies_node);
+		xml.writeStartElement("assemblies");
 		for (int i = 0; i < assemblies.size(); ++i) {
-			QDomElement assembly_node = doc.createElement("assembly");
-			assembly_node.setAttribute("end_effector", assemblies[i]->end_effector->id);
+			xml.writeStartElement("assembly");
+			xml.writeAttribute("end_effector", QString::number(points.ids[assemblies[i]->end_effector]));
 
 			// write gears
 			for (int j = 0; j < assemblies[i]->gears.size(); ++j) {
-				QDomElement gear_node = doc.createElement("gear");
-				gear_node.setAttribute("x", assemblies[i]->gears[j].center.x);
-				gear_node.setAttribute("y", assemblies[i]->gears[j].center.y);
-				gear_node.setAttribute("radius", assemblies[i]->gears[j].radius);
-				gear_node.setAttribute("phase", assemblies[i]->gears[j].phase);
-				gear_node.setAttribute("speed", assemblies[i]->gears[j].speed);
-				
-				assembly_node.appendChild(gear_node);
+				xml.writeStartElement("gear");
+				xml.writeAttribute("x", QString::number(assemblies[i]->gears[j].center.x));
+				xml.writeAttribute("y", QString::number(assemblies[i]->gears[j].center.y));
+				xml.writeAttribute("radius", QString::number(assemblies[i]->gears[j].radius));
+				xml.writeAttribute("phase", QString::number(assemblies[i]->gears[j].phase));
+				xml.writeAttribute("speed", QString::number(assemblies[i]->gears[j].speed));
+				xml.writeEndElement();
 			}
 
 			// write order
-			QDomElement order_node = doc.createElement("order");
-			order_node.setAttribute("id1", assemblies[i]->order.first);
-			order_node.setAttribute("id2", assemblies[i]->order.second);
-			assembly_node.appendChild(order_node);
+			xml.writeStartElement("order");
+			xml.writeAttribute("id1", QString::number(assemblies[i]->order.first));
+			xml.writeAttribute("id2", QString::number(assemblies[i]->order.second));
+			xml.writeEndElement();
 
 			// write links
 			for (int j = 0; j < assemblies[i]->link_lengths.size(); ++j) {
-				QDomElement link_node = doc.createElement("link");
-				link_node.setAttribute("length", assemblies[i]->link_lengths[j]);
-				assembly_node.appendChild(link_node);
+				xml.writeStartElement("link");
+				xml.writeAttribute("length", QString::number(assemblies[i]->link_lengths[j]));
+				xml.writeEndElement();
 			}
 
-			assemblies_node.appendChild(assembly_node);
+			xml.writeEndElement();
 		}
+		xml.writeEndElement();
 
 		// write links
-		QDomElement links_node = doc.createElement("links");
-		root.appendChild(links_node);
-		for (auto it = points.begin(); it != points.end(); ++it) {
-			for (int j = 0; j < it.value()->in_links.size(); ++j) {
-				QDomElement link_node = doc.createElement("link");
-				link_node.setAttribute("order", j);
-				link_node.setAttribute("start", it.value()->in_links[j]->start);
-				link_node.setAttribute("end", it.value()->in_links[j]->end);
-				links_node.appendChild(link_node);
+		xml.writeStartElement("links");
+		for (int i = 0; i < points.size(); ++i) {
+			for (int j = 0; j < points.numInLinks(i); ++j) {
+				if (points.inLink(i, j) < 0) continue;
+
+				const Link& link = links[points.inLink(i, j)];
+				xml.writeStartElement("link");
+				xml.writeAttribute("order", QString::number(j));
+				xml.writeAttribute("start", QString::number(points.ids[link.start]));
+				xml.writeAttribute("end", QString::number(points.ids[link.end]));
+				xml.writeEndElement();
 			}
 		}
+		xml.writeEndElement();
 
 		// write bodies
-		QDomElement bodies_node = doc.createElement("bodies");
-		root.appendChild(bodies_node);
+		xml.writeStartElement("bodies");
 		for (int i = 0; i < bodies.size(); ++i) {
-			QDomElement body_node = doc.createElement("body");
-			body_node.setAttribute("id1", bodies[i].pivot1);
-			body_node.setAttribute("id2", bodies[i].pivot2);
-			bodies_node.appendChild(body_node);
+			xml.writeStartElement("body");
+			xml.writeAttribute("id1", QString::number(points.ids[bodies[i].pivot1]));
+			xml.writeAttribute("id2", QString::number(points.ids[bodies[i].pivot2]));
 
 			// setup rotation matrix
-			glm::vec2 dir = points[bodies[i].pivot2]->pos - points[bodies[i].pivot1]->pos;
+			glm::vec2 dir = points.pos(bodies[i].pivot2) - points.pos(bodies[i].pivot1);
 			float angle = atan2f(dir.y, dir.x);
-			glm::vec2 p1 = (points[bodies[i].pivot1]->pos + points[bodies[i].pivot2]->pos) * 0.5f;
+			glm::vec2 p1 = (points.pos(bodies[i].pivot1) + points.pos(bodies[i].pivot2)) * 0.5f;
 			glm::mat4x4 model;
 			model = glm::rotate(model, angle, glm::vec3(0, 0, 1));
-			
+
 			for (int k = 0; k < bodies[i].points.size(); ++k) {
 				// convert the coordinates to the local coordinate system
 				glm::vec2 rotated_p = glm::vec2(model * glm::vec4(bodies[i].points[k].x, bodies[i].points[k].y, 0, 1)) + p1;
 
-				QDomElement point_node = doc.createElement("point");
-				point_node.setAttribute("x", rotated_p.x);
-				point_node.setAttribute("y", rotated_p.y);
-				body_node.appendChild(point_node);
+				xml.writeStartElement("point");
+				xml.writeAttribute("x", QString::number(rotated_p.x));
+				xml.writeAttribute("y", QString::number(rotated_p.y));
+				xml.writeEndElement();
 			}
+
+			xml.writeEndElement();
 		}
+		xml.writeEndElement();
 
-		QTextStream out(&file);
-		doc.save(out, 4);
+		xml.writeEndDocument();
 	}
 
-	void Kinematics::forwardKinematics() {
-		try {
-			std::list<boost::shared_ptr<Point>> queue;
-			for (auto it = points.begin(); it != points.end(); ++it) {
-				queue.push_back(*it);
+	/**
+	 * Load a binary design. The file is memory-mapped, and its arrays, including the
+	 * precompiled solve schedule, are copied as they are after the checksum, the
+	 * indices and the order of the schedule have been verified.
+	 */
+	void Kinematics::loadBinary(const QString& filename) {
+		QFile file(filename);
+		if (!file.open(QFile::ReadOnly)) throw "File cannot open.";
+
+		qint64 size = file.size();
+		if (size < sizeof(BinaryHeader)) throw "Invalid file format.";
+		const unsigned char* data = file.map(0, size);
+		if (data == NULL) throw "File cannot open.";
+
+		const BinaryHeader* header = reinterpret_cast<const BinaryHeader*>(data);
+		if (memcmp(header->magic, BINARY_MAGIC, 4) != 0) throw "Invalid file format.";
+		if (header->version != BINARY_VERSION) throw "Unsupported file version.";
+		if (header->payload_size != size - sizeof(BinaryHeader)) throw "Invalid file format.";
+
+		const unsigned char* ptr = data + sizeof(BinaryHeader);
+		const unsigned char* end = data + size;
+		if (fnv1a(ptr, end - ptr) != header->checksum) throw "Checksum mismatch.";
+
+		const int* ids = takeArray<int>(ptr, end, header->num_points);
+		const float* x = takeArray<float>(ptr, end, header->num_points);
+		const float* y = takeArray<float>(ptr, end, header->num_points);
+		const BinaryLink* link_records = takeArray<BinaryLink>(ptr, end, header->num_links);
+		const BinaryAssembly* assembly_records = takeArray<BinaryAssembly>(ptr, end, header->num_assemblies);
+		const BinaryGear* gear_records = takeArray<BinaryGear>(ptr, end, header->num_gears);
+		const float* lengths = takeArray<float>(ptr, end, header->num_lengths);
+		const BinaryBody* body_records = takeArray<BinaryBody>(ptr, end, header->num_bodies);
+		const glm::vec2* body_points = takeArray<glm::vec2>(ptr, end, header->num_body_points);
+		const BinarySolveStep* step_records = takeArray<BinarySolveStep>(ptr, end, header->num_solve_steps);
+
+		// verify everything in a new design, so that this one is left as it is if the file is rejected
+		Kinematics design;
+
+		int num_points = header->num_points;
+		design.points.ids.assign(ids, ids + num_points);
+		design.points.x.assign(x, x + num_points);
+		design.points.y.assign(y, y + num_points);
+		design.points.index_of.reserve(num_points);
+		for (int i = 0; i < num_points; ++i) {
+			if (ids[i] < 0) throw "Invalid point id.";
+			if (!design.points.index_of.insert(std::make_pair(ids[i], i)).second) throw "Invalid point id.";
+		}
+
+		for (int i = 0; i < header->num_links; ++i) {
+			const BinaryLink& r = link_records[i];
+			if (r.start < 0 || r.start >= num_points || r.end < 0 || r.end >= num_points) throw "Invalid point id.";
+			if (r.order < 0 || r.order > 1) throw "Invalid link order.";
+			design.links.push_back(Link(r.start, r.end, r.order, r.length));
+		}
+
+		for (int i = 0; i < header->num_assemblies; ++i) {
+			const BinaryAssembly& r = assembly_records[i];
+			if (r.end_effector < 0 || r.end_effector >= num_points) throw "Invalid point id.";
+
+			// the ranges are compared by their sizes, so that the sums do not overflow
+			if (r.first_gear < 0 || r.num_gears < 0 || r.num_gears > header->num_gears - r.first_gear) throw "Invalid file format.";
+			if (r.first_length < 0 || r.num_lengths < 0 || r.num_lengths > header->num_lengths - r.first_length) throw "Invalid file format.";
+
+			// the ordered gears drive the links of the same indices, and the links 0 and 2 make the end effector
+			if (r.num_lengths < 3) throw "Invalid assembly.";
+			if (r.order1 < 0 || r.order1 >= std::min(r.num_gears, r.num_lengths) || r.order2 < 0 || r.order2 >= std::min(r.num_gears, r.num_lengths)) throw "Invalid assembly.";
+
+			boost::shared_ptr<MechanicalAssembly> ass = boost::shared_ptr<MechanicalAssembly>(new MechanicalAssembly());
+			ass->setPhase(r.phase);
+			ass->end_effector = r.end_effector;
+			ass->order = std::make_pair(r.order1, r.order2);
+			for (int j = 0; j < r.num_gears; ++j) {
+				const BinaryGear& g = gear_records[r.first_gear + j];
+				ass->gears.push_back(Gear(glm::vec2(g.x, g.y), g.radius, g.phase, g.speed));
 			}
+			ass->link_lengths.assign(lengths + r.first_length, lengths + r.first_length + r.num_lengths);
+			design.assemblies.push_back(ass);
+		}
 
-			std::map<int, bool> updated;
-			for (auto it = points.begin(); it != points.end(); ++it) {
-				updated[it.key()];
+		for (int i = 0; i < header->num_bodies; ++i) {
+			const BinaryBody& r = body_records[i];
+			if (r.pivot1 < 0 || r.pivot1 >= num_points || r.pivot2 < 0 || r.pivot2 >= num_points) throw "Invalid point id.";
+			if (r.first_point < 0 || r.num_points < 0 || r.num_points > header->num_body_points - r.first_point) throw "Invalid file format.";
+
+			Part part(r.pivot1, r.pivot2);
+			part.points.assign(body_points + r.first_point, body_points + r.first_point + r.num_points);
+			design.bodies.push_back(part);
+		}
+
+		for (int i = 0; i < header->num_solve_steps; ++i) {
+			const BinarySolveStep& r = step_records[i];
+			if (r.point < 0 || r.point >= num_points || r.parent1 < 0 || r.parent1 >= num_points || r.parent2 < 0 || r.parent2 >= num_points) throw "Invalid point id.";
+			if (r.link1 < 0 || r.link1 >= design.links.size() || r.link2 < 0 || r.link2 >= design.links.size()) throw "Invalid file format.";
+
+			design.solve_schedule.push_back(SolveStep(r.point, r.parent1, r.parent2, r.link1, r.link2));
+		}
+
+		file.unmap(const_cast<unsigned char*>(data));
+
+		design.points.buildAdjacency(design.links);
+		design.checkSolveSchedule();
+		replaceDesign(design);
+	}
+
+	/**
+	 * Verify that the solve schedule is one that compile() could have made: every
+	 * point with two incoming links is solved once, from the links in their order,
+	 * after the points it depends on. A point with fewer links is not solved. Throws
+	 * otherwise.
+	 */
+	void Kinematics::checkSolveSchedule() const {
+		std::vector<int> step_of(points.size(), -1);
+		for (int i = 0; i < solve_schedule.size(); ++i) {
+			const SolveStep& step = solve_schedule[i];
+			if (points.numInLinks(step.point) != 2 || step_of[step.point] >= 0) throw "Invalid solve schedule.";
+			if (step.link1 != points.inLink(step.point, 0) || step.link2 != points.inLink(step.point, 1)) throw "Invalid solve schedule.";
+			if (step.parent1 != links[step.link1].start || step.parent2 != links[step.link2].start) throw "Invalid solve schedule.";
+
+			// the parents have to be placed by the earlier steps, unless they are not solved at all
+			if (points.numInLinks(step.parent1) == 2 && step_of[step.parent1] < 0) throw "Invalid solve schedule.";
+			if (points.numInLinks(step.parent2) == 2 && step_of[step.parent2] < 0) throw "Invalid solve schedule.";
+
+			step_of[step.point] = i;
+		}
+
+		for (int i = 0; i < points.size(); ++i) {
+			if (points.numInLinks(i) == 2 && step_of[i] < 0) throw "Invalid solve schedule.";
+		}
+	}
+
+	/**
+	 * Save the design as a binary design, including the current solve schedule.
+	 */
+	void Kinematics::saveBinary(const QString& filename) {
+		std::vector<unsigned char> payload;
+
+		appendArray(payload, points.ids.data(), points.size());
+		appendArray(payload, points.x.data(), points.size());
+		appendArray(payload, points.y.data(), points.size());
+
+		for (int i = 0; i < links.size(); ++i) {
+			BinaryLink r = { links[i].start, links[i].end, links[i].order, links[i].length };
+			appendArray(payload, &r, 1);
+		}
+
+		int num_gears = 0;
+		int num_lengths = 0;
+		for (int i = 0; i < assemblies.size(); ++i) {
+			BinaryAssembly r = { assemblies[i]->phase, assemblies[i]->end_effector, assemblies[i]->order.first, assemblies[i]->order.second, num_gears, (int)assemblies[i]->gears.size(), num_lengths, (int)assemblies[i]->link_lengths.size() };
+			appendArray(payload, &r, 1);
+			num_gears += assemblies[i]->gears.size();
+			num_lengths += assemblies[i]->link_lengths.size();
+		}
+		for (int i = 0; i < assemblies.size(); ++i) {
+			for (int j = 0; j < assemblies[i]->gears.size(); ++j) {
+				const Gear& gear = assemblies[i]->gears[j];
+				BinaryGear r = { gear.center.x, gear.center.y, gear.radius, gear.phase, gear.speed };
+				appendArray(payload, &r, 1);
 			}
+		}
+		for (int i = 0; i < assemblies.size(); ++i) {
+			appendArray(payload, assemblies[i]->link_lengths.data(), assemblies[i]->link_lengths.size());
+		}
 
-			while (!queue.empty()) {
-				boost::shared_ptr<Point> point = queue.front();
-				queue.pop_front();
+		int num_body_points = 0;
+		for (int i = 0; i < bodies.size(); ++i) {
+			BinaryBody r = { bodies[i].pivot1, bodies[i].pivot2, num_body_points, (int)bodies[i].points.size() };
+			appendArray(payload, &r, 1);
+			num_body_points += bodies[i].points.size();
+		}
+		for (int i = 0; i < bodies.size(); ++i) {
+			appendArray(payload, bodies[i].points.data(), bodies[i].points.size());
+		}
 
-				// if no parent points, set this point as updated.
-				if (point->in_links.size() == 0) {
-					updated[point->id] = true;
-					continue;
-				}
+		for (int i = 0; i < solve_schedule.size(); ++i) {
+			const SolveStep& step = solve_schedule[i];
+			BinarySolveStep r = { step.point, step.parent1, step.parent2, step.link1, step.link2 };
+			appendArray(payload, &r, 1);
+		}
 
-				if (point->in_links.size() > 2) throw "forward kinematics error. Overconstrained.";
+		BinaryHeader header;
+		memcpy(header.magic, BINARY_MAGIC, 4);
+		header.version = BINARY_VERSION;
+		header.checksum = fnv1a(payload.data(), payload.size());
+		header.payload_size = payload.size();
+		header.num_points = points.size();
+		header.num_links = links.size();
+		header.num_assemblies = assemblies.size();
+		header.num_gears = num_gears;
+		header.num_lengths = num_lengths;
+		header.num_bodies = bodies.size();
+		header.num_body_points = num_body_points;
+		header.num_solve_steps = solve_schedule.size();
 
-				// if the parent points are not updated, postpone updating this point
-				boost::shared_ptr<Link> l1 = point->in_links[0];
-				if (!updated[l1->start]) {
-					queue.push_back(point);
-					continue;
+		QFile file(filename);
+		if (!file.open(QFile::WriteOnly)) throw "File cannot open.";
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+	}
+
+	/**
+	 * Content hash of the design: the points (with the positions of those that are
+	 * not solved), the links, the assemblies with their gears, the phases as loaded,
+	 * and the bodies. Only what determines the simulation is hashed, in the order of
+	 * the dense indices, so the same design gives the same hash whether it is read
+	 * from XML or binary, and before or after it is solved or stepped.
+	 */
+	unsigned long long Kinematics::designHash() const {
+		DesignHasher hasher;
+		hasher.add(points.size());
+		for (int i = 0; i < points.size(); ++i) {
+			hasher.add(points.ids[i]);
+			if (!isSolved(i)) hasher.add(points.pos(i));
+		}
+
+		hasher.add((int)links.size());
+		for (int i = 0; i < links.size(); ++i) {
+			hasher.add(links[i].start);
+			hasher.add(links[i].end);
+			hasher.add(links[i].order);
+			hasher.add(links[i].length);
+		}
+
+		hasher.add((int)assemblies.size());
+		for (int i = 0; i < assemblies.size(); ++i) {
+			const MechanicalAssembly& ass = *assemblies[i];
+			hasher.add(ass.end_effector);
+			hasher.add(ass.order.first);
+			hasher.add(ass.order.second);
+			hasher.add((int)ass.link_lengths.size());
+			for (int k = 0; k < ass.link_lengths.size(); ++k) {
+				hasher.add(ass.link_lengths[k]);
+			}
+			hasher.add((int)ass.gears.size());
+			for (int j = 0; j < ass.gears.size(); ++j) {
+				hasher.add(ass.gears[j].center);
+				hasher.add(ass.gears[j].radius);
+				hasher.add(ass.gears[j].speed);
+			}
+		}
+
+		// the phases as loaded, so that the hash does not change as the design is stepped
+		hasher.add((int)initial_phases.size());
+		for (int i = 0; i < initial_phases.size(); ++i) {
+			hasher.add(&initial_phases[i].angle, sizeof(initial_phases[i].angle));
+		}
+
+		hasher.add((int)bodies.size());
+		for (int i = 0; i < bodies.size(); ++i) {
+			hasher.add(bodies[i].pivot1);
+			hasher.add(bodies[i].pivot2);
+			hasher.add((int)bodies[i].points.size());
+			for (int k = 0; k < bodies[i].points.size(); ++k) {
+				hasher.add(bodies[i].points[k]);
+			}
+		}
+
+		return hasher.hash;
+	}
+
+	/**
+	 * Return whether the position of the point is computed by the solver, i.e., it is
+	 * placed by a step of the solve schedule or it is the end effector of an assembly.
+	 */
+	bool Kinematics::isSolved(int index) const {
+		if (solve_step_of[index] >= 0) return true;
+		for (int i = 0; i < assemblies.size(); ++i) {
+			if (assemblies[i]->end_effector == index) return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Return whether the other design has the same points, links, assemblies, gears
+	 * and bodies connected in the same way, so that they differ in their numeric
+	 * parameters only.
+	 */
+	bool Kinematics::sameStructure(const Kinematics& other) const {
+		if (points.ids != other.points.ids) return false;
+
+		if (links.size() != other.links.size()) return false;
+		for (int i = 0; i < links.size(); ++i) {
+			if (links[i].start != other.links[i].start || links[i].end != other.links[i].end || links[i].order != other.links[i].order) return false;
+		}
+
+		if (assemblies.size() != other.assemblies.size()) return false;
+		for (int i = 0; i < assemblies.size(); ++i) {
+			const MechanicalAssembly& a = *assemblies[i];
+			const MechanicalAssembly& b = *other.assemblies[i];
+			if (a.end_effector != b.end_effector || a.order != b.order || a.gears.size() != b.gears.size() || a.link_lengths.size() != b.link_lengths.size()) return false;
+		}
+
+		if (bodies.size() != other.bodies.size()) return false;
+		for (int i = 0; i < bodies.size(); ++i) {
+			if (bodies[i].pivot1 != other.bodies[i].pivot1 || bodies[i].pivot2 != other.bodies[i].pivot2 || bodies[i].points.size() != other.bodies[i].points.size()) return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Apply the numeric parameters that changed from the previous version of the
+	 * design to the new one, both of the same structure as this one, without
+	 * rebuilding the points, links and bodies. The changed gears and assemblies are
+	 * marked dirty, and so are the moved ground points and the ends of the resized
+	 * links, so that the next forwardKinematicsIncremental() updates only the
+	 * affected part of the mechanism. The phases are shifted by the change instead of
+	 * set, so that the mechanism keeps running from where it is. The parameters that
+	 * did not change keep their current values, e.g., a dragged gear stays where it
+	 * is. Returns the number of changed parameters.
+	 */
+	int Kinematics::patch(const Kinematics& previous, const Kinematics& design) {
+		int num_changed = 0;
+
+		// the solved points are placed by the solver, so only the ground points are moved
+		for (int i = 0; i < points.size(); ++i) {
+			if (design.points.pos(i) == previous.points.pos(i) || isSolved(i)) continue;
+			points.setPos(i, design.points.pos(i));
+			markPointDirty(i);
+			num_changed++;
+		}
+
+		for (int i = 0; i < links.size(); ++i) {
+			if (design.links[i].length == previous.links[i].length) continue;
+			links[i].length = design.links[i].length;
+			markPointDirty(links[i].end);
+			num_changed++;
+		}
+
+		for (int i = 0; i < assemblies.size(); ++i) {
+			MechanicalAssembly& ass = *assemblies[i];
+			const MechanicalAssembly& prev = *previous.assemblies[i];
+			const MechanicalAssembly& next = *design.assemblies[i];
+			int num_assembly_changed = 0;
+
+			if (next.phase != prev.phase) {
+				ass.setPhase(ass.phase + next.phase - prev.phase);
+				num_assembly_changed++;
+			}
+			for (int k = 0; k < ass.link_lengths.size(); ++k) {
+				if (next.link_lengths[k] == prev.link_lengths[k]) continue;
+				ass.link_lengths[k] = next.link_lengths[k];
+				num_assembly_changed++;
+			}
+			for (int j = 0; j < ass.gears.size(); ++j) {
+				Gear& gear = ass.gears[j];
+				const Gear& prev_gear = prev.gears[j];
+				const Gear& next_gear = next.gears[j];
+				if (next_gear.center != prev_gear.center) {
+					gear.center = next_gear.center;
+					num_assembly_changed++;
 				}
-				if (point->in_links.size() == 2) {
-					boost::shared_ptr<Link> l2 = point->in_links[1];
-					if (!updated[l2->start]) {
-						queue.push_back(point);
-						continue;
-					}
+				if (next_gear.radius != prev_gear.radius) {
+					gear.radius = next_gear.radius;
+					num_assembly_changed++;
+				}
+				if (next_gear.speed != prev_gear.speed) {
+					gear.speed = next_gear.speed;
+					num_assembly_changed++;
+				}
+				if (next_gear.phase != prev_gear.phase) {
+					PhaseClock clock;
+					clock.set(gear.phase + next_gear.phase - prev_gear.phase);
+					gear.setClock(clock);
+					num_assembly_changed++;
+				}
+			}
+
+			if (num_assembly_changed > 0) {
+				ass.invalidate();
+				markAssemblyDirty(i);
+				num_changed += num_assembly_changed;
+			}
+		}
+
+		// the bodies are only drawn
+		for (int i = 0; i < bodies.size(); ++i) {
+			if (design.bodies[i].points == previous.bodies[i].points) continue;
+			bodies[i].points = design.bodies[i].points;
+			num_changed++;
+		}
+
+		// the cycle of the design now starts from the phases in the new version
+		initial_phases = design.initial_phases;
+
+		return num_changed;
+	}
+
+	/**
+	 * Compile the point/link graph into a topologically ordered list of dyad solves.
+	 * This has to be called whenever points or links are added or removed.
+	 */
+	void Kinematics::compile() {
+		solve_schedule.clear();
+
+		// count the parents of each point that have to be updated before the point itself
+		std::vector<int> num_waiting(points.size());
+		std::vector<int> queue;
+		queue.reserve(points.size());
+		for (int i = 0; i < points.size(); ++i) {
+			if (points.numInLinks(i) > 2) throw "forward kinematics error. Overconstrained.";
+			for (int k = 0; k < points.numInLinks(i); ++k) {
+				if (points.inLink(i, k) < 0) throw "forward kinematics error. Missing link.";
+			}
 
-					// update this point based on two adjacent points
-					point->pos = circleCircleIntersection(points[l1->start]->pos, l1->length, points[l2->start]->pos, l2->length);
+			num_waiting[i] = points.numInLinks(i);
+			if (num_waiting[i] == 0) queue.push_back(i);
+		}
+
+		// visit the points in the order their parents get updated
+		for (int i = 0; i < queue.size(); ++i) {
+			int point = queue[i];
+
+			if (points.numInLinks(point) == 2) {
+				int l1 = points.inLink(point, 0);
+				int l2 = points.inLink(point, 1);
+				solve_schedule.push_back(SolveStep(point, links[l1].start, links[l2].start, l1, l2));
+			}
+			else {
+				// pin joint
+			}
+
+			for (int k = 0; k < points.numOutLinks(point); ++k) {
+				int child = links[points.outLink(point, k)].end;
+				if (--num_waiting[child] == 0) queue.push_back(child);
+			}
+		}
+
+		// the points that were never reached depend on each other
+		if (queue.size() < points.size()) throw "forward kinematics error. Cyclic dependency.";
+
+		indexSolveSchedule();
+	}
+
+	/**
+	 * Map each point to its step in the solve schedule (-1 for the points that are
+	 * not solved, e.g., the end effectors), and reset the dirty flags.
+	 */
+	void Kinematics::indexSolveSchedule() {
+		solve_step_of.assign(points.size(), -1);
+		for (int i = 0; i < solve_schedule.size(); ++i) {
+			solve_step_of[solve_schedule[i].point] = i;
+		}
+
+		dirty.assign(points.size(), 0);
+		dirty_assemblies.clear();
+		dirty_points.clear();
+		dirty_steps.clear();
+		revision++;
+	}
+
+	SolveStatus Kinematics::assemblyFailure(int index) const {
+		SolveStatus status;
+		status.code = SolveStatus::ASSEMBLY_FAILED;
+		status.assembly = index;
+		status.point = points.ids[assemblies[index]->end_effector];
+		status.phase = assemblies[0]->phase;
+		return status;
+	}
+
+	SolveStatus Kinematics::dyadFailure(const SolveStep& step) const {
+		SolveStatus status;
+		status.code = SolveStatus::DYAD_FAILED;
+		status.point = points.ids[step.point];
+		status.link1 = step.link1;
+		status.link2 = step.link2;
+		status.phase = assemblies.empty() ? 0 : assemblies[0]->phase;
+		return status;
+	}
+
+	/**
+	 * The design as the model of solveForward(), solved in place. The end effectors
+	 * are taken from the cached states of the assemblies.
+	 */
+	class InPlaceModel {
+	public:
+		const Kinematics& design;
+		std::vector<float>& x;
+		std::vector<float>& y;
+
+		InPlaceModel(Kinematics& kinematics) : design(kinematics), x(kinematics.points.x), y(kinematics.points.y) {}
+
+		float linkLength(int link) const {
+			return design.links[link].length;
+		}
+
+		bool solveAssembly(int index, float& end_x, float& end_y) const {
+			const AssemblyState& state = design.assemblies[index]->getState();
+			if (!state.assembled) return false;
+
+			end_x = state.end_effector.x;
+			end_y = state.end_effector.y;
+			return true;
+		}
+
+		SolveStatus failure(const SolveStatus& status) const {
+			return status;
+		}
+	};
+
+	/**
+	 * Update all the points. The solve stops at the first point that cannot be
+	 * placed, and the remaining points keep their previous positions.
+	 */
+	SolveStatus Kinematics::forwardKinematics() {
+		// everything is updated, including the dirty assemblies and points, so the
+		// marks are consumed whether or not the solve succeeds
+		clearDirty();
+		revision++;
+
+		InPlaceModel model(*this);
+		return solveForward(*this, model);
+	}
+
+	/**
+	 * Mark an assembly whose phase has been changed, so that the next
+	 * forwardKinematicsIncremental() updates the points that depend on it.
+	 */
+	void Kinematics::markAssemblyDirty(int index) {
+		// there are few assemblies, so the list is just scanned
+		if (std::find(dirty_assemblies.begin(), dirty_assemblies.end(), index) != dirty_assemblies.end()) return;
+
+		dirty_assemblies.push_back(index);
+	}
+
+	/**
+	 * Mark a point that has been moved or whose incoming links have been resized, so
+	 * that the next forwardKinematicsIncremental() updates it and the points that
+	 * depend on it.
+	 */
+	void Kinematics::markPointDirty(int index) {
+		if (dirty[index]) return;
+
+		dirty[index] = 1;
+		dirty_points.push_back(index);
+	}
+
+	/**
+	 * Update only the points downstream of the assemblies and the points marked dirty
+	 * since the last update. The dirtiness is propagated from their end effectors along the outgoing
+	 * links, and the reached points are solved in the order of the solve schedule,
+	 * so the cost is proportional to the affected part of the mechanism.
+	 */
+	SolveStatus Kinematics::forwardKinematicsIncremental() {
+		revision++;
+
+		for (int i = 0; i < dirty_assemblies.size(); ++i) {
+			int point = assemblies[dirty_assemblies[i]]->end_effector;
+			if (!dirty[point]) {
+				dirty[point] = 1;
+				dirty_points.push_back(point);
+			}
+		}
+
+		// the list grows while it is scanned, so that it ends up with all the downstream points
+		for (int i = 0; i < dirty_points.size(); ++i) {
+			int point = dirty_points[i];
+			for (int k = 0; k < points.numOutLinks(point); ++k) {
+				int child = links[points.outLink(point, k)].end;
+				if (!dirty[child]) {
+					dirty[child] = 1;
+					dirty_points.push_back(child);
 				}
-				else {
-					// pin joint
+			}
+			if (solve_step_of[point] >= 0) dirty_steps.push_back(solve_step_of[point]);
+		}
+		std::sort(dirty_steps.begin(), dirty_steps.end());
+
+		InPlaceModel model(*this);
+		SolveStatus status;
+		for (int i = 0; i < dirty_assemblies.size() && status.ok(); ++i) {
+			int point = assemblies[dirty_assemblies[i]]->end_effector;
+			if (!model.solveAssembly(dirty_assemblies[i], points.x[point], points.y[point])) status = assemblyFailure(dirty_assemblies[i]);
+		}
+
+		for (int i = 0; i < dirty_steps.size() && status.ok(); ++i) {
+			const SolveStep& step = solve_schedule[dirty_steps[i]];
+			if (!solveDyad(model, step)) status = dyadFailure(step);
+		}
+
+		clearDirty();
+
+		return status;
+	}
+
+	/**
+	 * Clear the marks of the dirty assemblies and points, and the flags of the
+	 * marked points only.
+	 */
+	void Kinematics::clearDirty() {
+		for (int i = 0; i < dirty_points.size(); ++i) {
+			dirty[dirty_points[i]] = 0;
+		}
+		dirty_points.clear();
+		dirty_steps.clear();
+		dirty_assemblies.clear();
+	}
+
+	/**
+	 * Return the time after which the whole mechanism returns to its current state,
+	 * i.e., the common period of all the gears, or 0 if some gear speed is not a
+	 * rational multiple (with a small denominator) of the others.
+	 */
+	float Kinematics::cyclePeriod() const {
+		// the period of a gear of speed p/q is 2pi*q/p. Since the phase of the
+		// assemblies advances at speed 1, the common period is 2pi*lcm(q).
+		int lcm = 1;
+		for (int i = 0; i < assemblies.size(); ++i) {
+			for (int j = 0; j < assemblies[i]->gears.size(); ++j) {
+				double speed = fabs(assemblies[i]->gears[j].speed);
+
+				int q = 1;
+				for (; q <= 64; ++q) {
+					if (fabs(speed * q - floor(speed * q + 0.5)) <= speed * q * PERIOD_TOLERANCE) break;
 				}
-				updated[point->id] = true;
+				if (q > 64) return 0;
+
+				int a = lcm, b = q;
+				while (b != 0) { int t = a % b; a = b; b = t; }
+				lcm = lcm / a * q;
+				if (lcm > 1024) return 0;
+			}
+		}
+
+		return M_PI * 2 * lcm;
+	}
+
+	/**
+	 * Keep the current phase clocks as the ones from which the full cycle starts.
+	 */
+	void Kinematics::keepInitialPhases() {
+		initial_phases.clear();
+		for (int i = 0; i < assemblies.size(); ++i) {
+			initial_phases.push_back(assemblies[i]->clock);
+			for (int j = 0; j < assemblies[i]->gears.size(); ++j) {
+				initial_phases.push_back(assemblies[i]->gears[j].clock);
+			}
+		}
+	}
+
+	/**
+	 * Set the phases back to the ones as loaded, and restart recording the frames.
+	 * The points are placed by the next forwardKinematics().
+	 */
+	void Kinematics::rewind() {
+		const PhaseClock* phases = initial_phases.data();
+		for (int i = 0; i < assemblies.size(); ++i) {
+			assemblies[i]->setClock(*phases++);
+			for (int j = 0; j < assemblies[i]->gears.size(); ++j) {
+				assemblies[i]->gears[j].setClock(*phases++);
+			}
+		}
+		invalidateFrameCache();
+	}
+
+	/**
+	 * Return whether advancing all the phase clocks by the given number of steps
+	 * brings them back to where they are, in the fixed point as they are stepped.
+	 * The rounding of the time step is tolerated, but a speed that is only close to
+	 * a rational one is not, since restoring the cached frames would make it jump.
+	 */
+	bool Kinematics::isPeriodic(int num_steps, float time_step) const {
+		for (int i = 0; i < assemblies.size(); ++i) {
+			for (int j = -1; j < (int)assemblies[i]->gears.size(); ++j) {
+				// the assembly phase advances at speed 1
+				double step = j < 0 ? (double)time_step : (double)assemblies[i]->gears[j].speed * time_step;
+				long long drift = (long long)(toPhaseUnits(step) * (unsigned long long)num_steps);
+				if (fabs((double)drift) / PHASE_UNITS_PER_RADIAN > fabs(step) * num_steps * PERIOD_TOLERANCE) return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Discard the cached frames, and restart recording from the current state.
+	 * This has to be called whenever the state is changed other than by stepping,
+	 * e.g., when a gear is moved or a phase is changed.
+	 * If the mechanism is periodic, the time step is adjusted so that a period is
+	 * an integer number of frames. Otherwise, the frames are not cached.
+	 */
+	void Kinematics::invalidateFrameCache() {
+		float period = cyclePeriod();
+		int num_frames = period / DEFAULT_TIME_STEP + 0.5f;
+		if (period == 0 || num_frames > MAX_CACHED_FRAMES) num_frames = 0;
+		if (num_frames > 0 && !isPeriodic(num_frames, period / num_frames)) num_frames = 0;
+
+		time_step = num_frames > 0 ? period / num_frames : DEFAULT_TIME_STEP;
+
+		frame_cache.num_frames = num_frames;
+		frame_cache.num_points = points.size();
+		frame_cache.num_phases = assemblies.size();
+		for (int i = 0; i < assemblies.size(); ++i) {
+			frame_cache.num_phases += assemblies[i]->gears.size();
+		}
+		frame_cache.x.assign(num_frames * frame_cache.num_points, 0);
+		frame_cache.y.assign(num_frames * frame_cache.num_points, 0);
+		frame_cache.phases.assign(num_frames * frame_cache.num_phases, PhaseClock());
+		frame_cache.recorded.assign(num_frames, 0);
+		frame = 0;
+		revision++;
+
+		// the gears may have been moved or resized as well
+		for (int i = 0; i < assemblies.size(); ++i) {
+			assemblies[i]->invalidate();
+		}
+	}
+
+	void Kinematics::recordFrame(int index) {
+		std::copy(points.x.begin(), points.x.end(), frame_cache.x.begin() + index * frame_cache.num_points);
+		std::copy(points.y.begin(), points.y.end(), frame_cache.y.begin() + index * frame_cache.num_points);
+
+		PhaseClock* phases = &frame_cache.phases[index * frame_cache.num_phases];
+		for (int i = 0; i < assemblies.size(); ++i) {
+			*phases++ = assemblies[i]->clock;
+			for (int j = 0; j < assemblies[i]->gears.size(); ++j) {
+				*phases++ = assemblies[i]->gears[j].clock;
 			}
 		}
-		catch (char* ex) {
-			throw "forward kinematics error.";
+
+		frame_cache.recorded[index] = 1;
+	}
+
+	void Kinematics::restoreFrame(int index) {
+		revision++;
+
+		std::copy(frame_cache.x.begin() + index * frame_cache.num_points, frame_cache.x.begin() + (index + 1) * frame_cache.num_points, points.x.begin());
+		std::copy(frame_cache.y.begin() + index * frame_cache.num_points, frame_cache.y.begin() + (index + 1) * frame_cache.num_points, points.y.begin());
+
+		const PhaseClock* phases = &frame_cache.phases[index * frame_cache.num_phases];
+		for (int i = 0; i < assemblies.size(); ++i) {
+			assemblies[i]->setClock(*phases++);
+			for (int j = 0; j < assemblies[i]->gears.size(); ++j) {
+				assemblies[i]->gears[j].setClock(*phases++);
+			}
+		}
+	}
+
+	/**
+	 * Advance the mechanism by one frame forward (direction = 1) or backward
+	 * (direction = -1). Frames that have been solved once in the current period
+	 * are restored from the cache without solving. A frame that cannot be solved is
+	 * neither cached nor added to the traces, and the next step starts over from
+	 * the phases, so the callers can report the failure and keep stepping.
+	 */
+	SolveStatus Kinematics::step(int direction) {
+		int next = -1;
+		if (frame_cache.num_frames > 0) {
+			next = (frame + direction + frame_cache.num_frames) % frame_cache.num_frames;
+		}
+
+		if (next >= 0 && frame_cache.recorded[next]) {
+			restoreFrame(next);
+		}
+		else {
+			for (int i = 0; i < assemblies.size(); ++i) {
+				assemblies[i]->forward(time_step * direction);
+			}
+			SolveStatus status = forwardKinematics();
+			if (!status.ok()) {
+				if (next >= 0) frame = next;
+				return status;
+			}
+			if (next >= 0) recordFrame(next);
+		}
+		if (next >= 0) frame = next;
+
+		for (int i = 0; i < assemblies.size(); ++i) {
+			trace_end_effector[i].push_back(points.pos(assemblies[i]->end_effector));
+		}
+
+		return SolveStatus();
+	}
+
+	SolveStatus Kinematics::stepForward() {
+		return step(1);
+	}
+
+	SolveStatus Kinematics::stepBackward() {
+		return step(-1);
+	}
+
+	/**
+	 * Copy the design and its state into another instance. Unlike the assignment,
+	 * the assemblies are not shared, so the two instances can be stepped independently.
+	 * The gear outlines are not shared either, so that the copy can be drawn on
+	 * another thread. It builds its own as it is drawn.
+	 */
+	void Kinematics::copyTo(Kinematics& other) const {
+		other = *this;
+		for (int i = 0; i < assemblies.size(); ++i) {
+			other.assemblies[i] = boost::shared_ptr<MechanicalAssembly>(new MechanicalAssembly(*assemblies[i]));
 		}
+		other.gear_outlines.outlines.clear();
 	}
 
-	void Kinematics::stepForward() {
+	/**
+	 * Copy the current state into the snapshot. Once the snapshot has the right
+	 * sizes, this does not allocate.
+	 */
+	void Kinematics::takeSnapshot(KinematicsSnapshot& snapshot) const {
+		snapshot.x = points.x;
+		snapshot.y = points.y;
+
+		snapshot.phases.resize(frame_cache.num_phases);
+		PhaseClock* phases = snapshot.phases.data();
 		for (int i = 0; i < assemblies.size(); ++i) {
-			trace_end_effector[i].push_back(assemblies[i]->getEndEffectorPosition());
-			assemblies[i]->forward(0.03);
+			*phases++ = assemblies[i]->clock;
+			for (int j = 0; j < assemblies[i]->gears.size(); ++j) {
+				*phases++ = assemblies[i]->gears[j].clock;
+			}
 		}
 
-		forwardKinematics();
+		snapshot.traces = trace_end_effector;
+		snapshot.frame = frame;
 	}
 
-	void Kinematics::stepBackward() {
+	/**
+	 * Restore the state from a snapshot taken from a copy of this design.
+	 */
+	void Kinematics::applySnapshot(const KinematicsSnapshot& snapshot) {
+		if (snapshot.x.size() != points.size() || snapshot.phases.size() != frame_cache.num_phases) return;
+
+		points.x = snapshot.x;
+		points.y = snapshot.y;
+
+		const PhaseClock* phases = snapshot.phases.data();
 		for (int i = 0; i < assemblies.size(); ++i) {
-			trace_end_effector[i].push_back(assemblies[i]->getEndEffectorPosition());
-			assemblies[i]->forward(-0.03);
+			assemblies[i]->setClock(*phases++);
+			for (int j = 0; j < assemblies[i]->gears.size(); ++j) {
+				assemblies[i]->gears[j].setClock(*phases++);
+			}
 		}
 
-		forwardKinematics();
+		trace_end_effector = snapshot.traces;
+		frame = snapshot.frame;
+		revision++;
 	}
 
 	void Kinematics::draw(QPainter& painter) {
 		if (show_bodies) {
+			QTransform transform = painter.worldTransform();
+			painter.setPen(BODY_PEN);
+			painter.setBrush(BODY_BRUSH);
 			for (int i = 0; i < bodies.size(); ++i) {
-				painter.save();
-				painter.setPen(QPen(QColor(0, 0, 0), 1));
-				painter.setBrush(QBrush(QColor(0, 255, 0, 60)));
-				glm::vec2 dir = points[bodies[i].pivot2]->pos - points[bodies[i].pivot1]->pos;
+				glm::vec2 dir = points.pos(bodies[i].pivot2) - points.pos(bodies[i].pivot1);
 				float angle = atan2f(dir.y, dir.x) / M_PI * 180;
-				glm::vec2 p1 = (points[bodies[i].pivot1]->pos + points[bodies[i].pivot2]->pos) * 0.5f;
+				glm::vec2 p1 = (points.pos(bodies[i].pivot1) + points.pos(bodies[i].pivot2)) * 0.5f;
 				painter.translate(p1.x, p1.y);
 				painter.rotate(angle);
-				std::vector<QPointF> points;
+				body_polygon.resize(bodies[i].points.size());
 				for (int k = 0; k < bodies[i].points.size(); ++k) {
-					points.push_back(QPointF(bodies[i].points[k].x, bodies[i].points[k].y));
+					body_polygon[k] = QPointF(bodies[i].points[k].x, bodies[i].points[k].y);
 				}
-				painter.drawPolygon(points.data(), points.size());
+				painter.drawPolygon(body_polygon.data(), body_polygon.size());
 				//painter.drawEllipse(QPointF(0, 0), glm::length(dir1) * 0.6, glm::length(dir1) * 0.2);
-				painter.restore();
+				painter.setWorldTransform(transform);
 			}
 		}
 
 		if (show_assemblies) {
 			// draw trace
-			painter.setPen(QPen(QColor(255, 0, 0), 1));
 			for (int i = 0; i < trace_end_effector.size(); ++i) {
-				if (trace_end_effector[i].size() > 0) {
-					for (int j = std::max(0, (int)trace_end_effector[i].size() - 240); j < trace_end_effector[i].size() - 1; ++j) {
-						painter.drawLine(trace_end_effector[i][j].x, trace_end_effector[i][j].y, trace_end_effector[i][j + 1].x, trace_end_effector[i][j + 1].y);
-					}
-				}
+				trace_painter.draw(painter, trace_end_effector[i], TRACE_PEN);
 			}
 
 			// draw assembly
 			for (int i = 0; i < assemblies.size(); ++i) {
-				assemblies[i]->draw(painter);
+				assemblies[i]->draw(painter, gear_outlines);
 			}
 		}
 
 		if (show_links) {
 			// draw links
-			painter.setPen(QPen(QColor(0, 0, 0), 3));
-			painter.setBrush(QBrush(QColor(255, 255, 255)));
+			painter.setPen(LINK_PEN);
+			painter.setBrush(JOINT_BRUSH);
 			for (int i = 0; i < links.size(); ++i) {
-				painter.drawLine(points[links[i]->start]->pos.x, points[links[i]->start]->pos.y, points[links[i]->end]->pos.x, points[links[i]->end]->pos.y);
-				painter.drawEllipse(QPoint(points[links[i]->start]->pos.x, points[links[i]->start]->pos.y), 3, 3);
-				painter.drawEllipse(QPoint(points[links[i]->end]->pos.x, points[links[i]->end]->pos.y), 3, 3);
+				float x1 = points.x[links[i].start];
+				float y1 = points.y[links[i].start];
+				float x2 = points.x[links[i].end];
+				float y2 = points.y[links[i].end];
+				painter.drawLine(x1, y1, x2, y2);
+				painter.drawEllipse(QPoint(x1, y1), 3, 3);
+				painter.drawEllipse(QPoint(x2, y2), 3, 3);
 			}
 		}
 	}
@@ -500,4 +1734,8 @@ namespace kinematics {
 		show_bodies = flag;
 	}
 
+	void Kinematics::fadeTraces(bool flag) {
+		trace_painter.fade_bands = flag ? 8 : 0;
+	}
+
 }
@@ -1,37 +1,125 @@
 #pragma once
 
 #include <QPainter>
+#include <QPainterPath>
 #include <vector>
+#include <map>
+#include <unordered_map>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <boost/shared_ptr.hpp>
-#include <QMap>
+#include "RingBuffer.h"
+#include "TracePainter.h"
+#include "KinematicsCore.h"
 
 namespace kinematics {
-	glm::vec2 circleCircleIntersection(const glm::vec2& center1, float radius1, const glm::vec2& center2, float radius);
+	class Link {
+	public:
+		int start;
+		int end;
+		int order;
+		float length;
 
-	class Link;
+	public:
+		Link() {}
+		Link(int start, int end, int order, float length);
+	};
 
-	class Point {
+	/**
+	 * Result of a solve. The solvers do not throw, and a failure is described by
+	 * the point that cannot be placed (its id in the design file) with the two links
+	 * whose circles do not intersect, or by the assembly that cannot be assembled.
+	 * The phase is that of the first assembly, which the others advance with.
+	 */
+	class SolveStatus {
 	public:
-		int id;
-		glm::vec2 pos;
-		std::vector<boost::shared_ptr<Link>> out_links;
-		std::vector<boost::shared_ptr<Link>> in_links;
+		enum { OK = 0, ASSEMBLY_FAILED, DYAD_FAILED };
+
+		int code;
+		int point;
+		int link1;
+		int link2;
+		int assembly;
+		float phase;
 
 	public:
-		Point(int id, const glm::vec2& pos) : id(id), pos(pos) {}
+		SolveStatus() : code(OK), point(-1), link1(-1), link2(-1), assembly(-1), phase(0) {}
+
+		bool ok() const { return code == OK; }
+		QString message() const;
 	};
 
-	class Link {
+	/**
+	 * Dense storage of the points. The ids used in the design file, which may be
+	 * sparse, are remapped to contiguous indices, the positions are kept in separate x/y arrays, and the
+	 * incoming/outgoing links of each point are stored in CSR form.
+	 */
+	class PointStore {
 	public:
-		int start;
-		int end;
-		float length;
+		std::vector<int> ids;
+		std::vector<float> x;
+		std::vector<float> y;
+		std::unordered_map<int, int> index_of;
+		std::vector<int> in_offsets;
+		std::vector<int> in_links;
+		std::vector<int> out_offsets;
+		std::vector<int> out_links;
 
 	public:
-		Link() {}
-		Link(int start_point, int end_point, float length);
+		PointStore() {}
+
+		void clear();
+		int add(int id, const glm::vec2& pos);
+		int indexOf(int id) const;
+		int size() const { return ids.size(); }
+		glm::vec2 pos(int index) const { return glm::vec2(x[index], y[index]); }
+		void setPos(int index, const glm::vec2& pos) { x[index] = pos.x; y[index] = pos.y; }
+		int numInLinks(int index) const { return in_offsets[index + 1] - in_offsets[index]; }
+		int inLink(int index, int k) const { return in_links[in_offsets[index] + k]; }
+		int numOutLinks(int index) const { return out_offsets[index + 1] - out_offsets[index]; }
+		int outLink(int index, int k) const { return out_links[out_offsets[index] + k]; }
+		void buildAdjacency(const std::vector<Link>& links);
+	};
+
+	/**
+	 * Phase kept as a fixed-point fraction of a turn (2^64 per turn), so that it
+	 * wraps exactly and does not drift however long it is advanced, together with
+	 * its unit rotor (cos, sin). The rotor is advanced by a complex multiply with
+	 * the rotor of the step, which is computed once per step size, instead of
+	 * calling cos and sin on the phase. The same sequence of steps always gives
+	 * the same bits.
+	 */
+	class PhaseClock {
+	public:
+		unsigned long long angle;
+		glm::dvec2 rotor;
+
+		// the last step, and its angle and rotor
+		double step;
+		unsigned long long step_angle;
+		glm::dvec2 step_rotor;
+
+	public:
+		PhaseClock() : angle(0), rotor(1, 0), step(0), step_angle(0), step_rotor(1, 0) {}
+
+		void set(float radians);
+		void advance(double radians);
+		float radians() const;
+	};
+
+	/**
+	 * Tooth outlines of the gears in local coordinates, shared by the gears of the
+	 * same radius. QPainterPath fills its caches lazily even when it is only drawn,
+	 * so each design keeps its own, and it is drawn from one thread at a time.
+	 */
+	class GearOutlineCache {
+	public:
+		std::map<int, QPainterPath> outlines;
+
+	public:
+		GearOutlineCache() {}
+
+		const QPainterPath& get(float radius);
 	};
 
 	class Gear {
@@ -40,30 +128,60 @@ namespace kinematics {
 		float radius;
 		float phase;
 		float speed;
+		PhaseClock clock;
 
 	public:
-		Gear() {}
-		Gear(const glm::vec2& center, float radius, float phase, float speed) : center(center), radius(radius), phase(phase), speed(speed) {}
+		Gear() : phase(0) {}
+		Gear(const glm::vec2& center, float radius, float phase, float speed);
 
-		glm::vec2 getLinkEndPosition();
-		void draw(QPainter& painter);
+		void setClock(const PhaseClock& clock);
+		void advance(float time_step);
+		glm::vec2 getLinkEndPosition() const;
+		void draw(QPainter& painter, GearOutlineCache& outlines);
+	};
+
+	/**
+	 * Solved configuration of an assembly: the link ends on its gears, the
+	 * intermediate joint, and the end effector. It is valid while its generation
+	 * matches that of the assembly.
+	 */
+	class AssemblyState {
+	public:
+		int generation;
+		bool assembled;
+		std::vector<glm::vec2> link_ends;
+		glm::vec2 joint;
+		glm::vec2 end_effector;
+
+	public:
+		AssemblyState() : generation(-1), assembled(false) {}
 	};
 
 	class MechanicalAssembly {
 	public:
 		float phase;
+		PhaseClock clock;
 		std::vector<Gear> gears;
 		std::pair<int, int> order;
 		std::vector<float> link_lengths;
-		boost::shared_ptr<Point> end_effector;
+		int end_effector;
+
+		// incremented whenever the gears or the links change, so that the cached state is solved again
+		int generation;
+		mutable AssemblyState state;
 
 	public:
-		MechanicalAssembly() : phase(3.14) {}
+		MechanicalAssembly() : end_effector(-1), generation(0) { setPhase(3.14); }
 
-		glm::vec2 getIntermediateJointPosition();
-		glm::vec2 getEndEffectorPosition();
+		void invalidate() { generation++; }
+		void setPhase(float phase);
+		void setClock(const PhaseClock& clock);
+		const AssemblyState& getState() const;
+		bool getIntermediateJointPosition(glm::vec2& joint) const;
+		bool getEndEffectorPosition(glm::vec2& pos) const;
 		void forward(float time_step);
-		void draw(QPainter& painter);
+		bool sampleEndEffectorPositions(float time_step, int num_samples, std::vector<glm::vec2>& positions) const;
+		void draw(QPainter& painter, GearOutlineCache& outlines);
 	};
 
 	class Part {
@@ -76,13 +194,82 @@ namespace kinematics {
 		Part(int pivot1, int pivot2) : pivot1(pivot1), pivot2(pivot2) {}
 	};
 
+	/**
+	 * One dyad solve of the compiled schedule: the point is placed at the
+	 * intersection of the circles around the start points of its two incoming links.
+	 */
+	class SolveStep {
+	public:
+		int point;
+		int parent1;
+		int parent2;
+		int link1;
+		int link2;
+
+	public:
+		SolveStep(int point, int parent1, int parent2, int link1, int link2) : point(point), parent1(parent1), parent2(parent2), link1(link1), link2(link2) {}
+	};
+
+	/**
+	 * One period of a periodic mechanism: the point positions and the phase clocks
+	 * of the assemblies and their gears at each frame, recorded lazily as the frames
+	 * are solved for the first time.
+	 */
+	class FrameCache {
+	public:
+		int num_frames;
+		int num_points;
+		int num_phases;
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<PhaseClock> phases;
+		std::vector<unsigned char> recorded;
+
+	public:
+		FrameCache() : num_frames(0), num_points(0), num_phases(0) {}
+	};
+
+	/**
+	 * Copy of the state needed to draw the mechanism: the point positions, the
+	 * phase clocks in the same layout as the frame cache, and the traces.
+	 */
+	class KinematicsSnapshot {
+	public:
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<PhaseClock> phases;
+		std::vector<RingBuffer<glm::vec2>> traces;
+		int frame;
+
+	public:
+		KinematicsSnapshot() : frame(0) {}
+	};
+
 	class Kinematics {
 	public:
-		QMap<int, boost::shared_ptr<Point>> points;
-		std::vector<boost::shared_ptr<Link>> links;
+		PointStore points;
+		std::vector<Link> links;
 		std::vector<boost::shared_ptr<MechanicalAssembly>> assemblies;
 		std::vector<Part> bodies;
-		std::vector<std::vector<glm::vec2>> trace_end_effector;
+		std::vector<RingBuffer<glm::vec2>> trace_end_effector;
+		TracePainter trace_painter;
+		GearOutlineCache gear_outlines;
+		std::vector<QPointF> body_polygon;
+		std::vector<SolveStep> solve_schedule;
+		std::vector<int> solve_step_of;
+		std::vector<int> dirty_assemblies;
+		std::vector<unsigned char> dirty;
+		std::vector<int> dirty_points;
+		std::vector<int> dirty_steps;
+		float time_step;
+		FrameCache frame_cache;
+		int frame;
+
+		// the phase clocks as loaded, in the same layout as the frame cache, from which the full cycle starts
+		std::vector<PhaseClock> initial_phases;
+
+		// incremented whenever the geometry changes, so that the views can tell when to refresh
+		int revision;
 
 		bool show_assemblies;
 		bool show_links;
@@ -93,13 +280,41 @@ namespace kinematics {
 
 		void load(const QString& filename);
 		void save(const QString& filename);
-		void forwardKinematics();
-		void stepForward();
-		void stepBackward();
+		void loadBinary(const QString& filename);
+		void saveBinary(const QString& filename);
+		void checkSolveSchedule() const;
+		void replaceDesign(Kinematics& design);
+		unsigned long long designHash() const;
+		bool isSolved(int index) const;
+		bool sameStructure(const Kinematics& other) const;
+		int patch(const Kinematics& previous, const Kinematics& design);
+		void compile();
+		void indexSolveSchedule();
+		SolveStatus forwardKinematics();
+		void markAssemblyDirty(int index);
+		void markPointDirty(int index);
+		SolveStatus forwardKinematicsIncremental();
+		void clearDirty();
+		SolveStatus assemblyFailure(int index) const;
+		SolveStatus dyadFailure(const SolveStep& step) const;
+		float cyclePeriod() const;
+		bool isPeriodic(int num_steps, float time_step) const;
+		void keepInitialPhases();
+		void rewind();
+		void invalidateFrameCache();
+		void recordFrame(int index);
+		void restoreFrame(int index);
+		SolveStatus step(int direction);
+		SolveStatus stepForward();
+		SolveStatus stepBackward();
+		void copyTo(Kinematics& other) const;
+		void takeSnapshot(KinematicsSnapshot& snapshot) const;
+		void applySnapshot(const KinematicsSnapshot& snapshot);
 		void draw(QPainter& painter);
 		void showAssemblies(bool flag);
 		void showLinks(bool flag);
 		void showBodies(bool flag);
+		void fadeTraces(bool flag);
 	};
 
 }
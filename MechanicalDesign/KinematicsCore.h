@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cmath>
+#include <glm/glm.hpp>
+#include "Geometry.h"
+#include "Dual.h"
+
+/**
+ * The scalar-generic parts of the forward kinematics, shared by Kinematics (float)
+ * and KinematicsSolver (double, Dual<double>, ...). The scalar type only needs the
+ * arithmetic operators, the comparisons, and sqrt/abs/cos/sin found by ADL or in std.
+ * The phases are kept by PhaseClocks in both, and the link ends are placed by the
+ * rotors of the clocks.
+ */
+namespace kinematics {
+	/**
+	 * Rotate (x, y) by the given angle.
+	 */
+	template<typename T>
+	inline void rotate(T angle, T& x, T& y) {
+		using std::cos;
+		using std::sin;
+
+		T c = cos(angle);
+		T s = sin(angle);
+		T rotated_x = x * c - y * s;
+		y = x * s + y * c;
+		x = rotated_x;
+	}
+
+	/**
+	 * Rotor of a gear whose phase is delta ahead of the phase its clock keeps. When
+	 * delta is 0, the rotor of the clock is taken as it is, so that the phases
+	 * advance exactly as Kinematics steps them.
+	 */
+	template<typename T>
+	inline void phaseRotor(const glm::dvec2& rotor, T delta, T& rotor_x, T& rotor_y) {
+		rotor_x = T(rotor.x);
+		rotor_y = T(rotor.y);
+		if (delta != T(0)) rotate(delta, rotor_x, rotor_y);
+	}
+
+	/**
+	 * The dual numbers always take the rotation, since their comparisons only look at
+	 * the values, and a delta of 0 still carries the derivative of the phase.
+	 */
+	template<typename S>
+	inline void phaseRotor(const glm::dvec2& rotor, Dual<S> delta, Dual<S>& rotor_x, Dual<S>& rotor_y) {
+		rotor_x = Dual<S>(S(rotor.x));
+		rotor_y = Dual<S>(S(rotor.y));
+		rotate(delta, rotor_x, rotor_y);
+	}
+
+	/**
+	 * Position of the end of the link attached to a gear, given the rotor of its phase.
+	 */
+	template<typename T>
+	inline void linkEndPosition(T center_x, T center_y, T radius, T rotor_x, T rotor_y, T& x, T& y) {
+		x = center_x + rotor_x * radius;
+		y = center_y + rotor_y * radius;
+	}
+
+	/**
+	 * Solve an assembly given the link ends of its two ordered gears and of gear 0.
+	 * The intermediate joint connects the links from the ordered gears, and the end
+	 * effector is on the extension of the link from gear 0 through the joint.
+	 * Returns false if the links cannot be connected.
+	 */
+	template<typename T>
+	inline bool assemblyPositions(T x0, T y0, T x1, T y1, T length1, T x2, T y2, T length2, T length0, T extension, T& joint_x, T& joint_y, T& end_x, T& end_y) {
+		if (!geometry::circleCircleIntersection(x1, y1, length1, x2, y2, length2, geometry::CCW, joint_x, joint_y)) return false;
+
+		end_x = x0 + (joint_x - x0) / length0 * (length0 + extension);
+		end_y = y0 + (joint_y - y0) / length0 * (length0 + extension);
+		return true;
+	}
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "Kinematics.h"
+#include "KinematicsCore.h"
+#include "Dual.h"
+
+namespace kinematics {
+	/**
+	 * Place the point of a solve step at the intersection of the circles around its
+	 * parents. The model provides the positions x/y and linkLength(link). The point
+	 * keeps its position if the circles do not intersect.
+	 */
+	template<typename Model>
+	inline bool solveDyad(Model& model, const SolveStep& step) {
+		return geometry::circleCircleIntersection(model.x[step.parent1], model.y[step.parent1], model.linkLength(step.link1), model.x[step.parent2], model.y[step.parent2], model.linkLength(step.link2), geometry::CCW, model.x[step.point], model.y[step.point]);
+	}
+
+	/**
+	 * Solve the end effectors of the assemblies and then the points in the order of
+	 * the schedule of the design. This is the forward kinematics of both Kinematics,
+	 * which solves the design in place, and KinematicsSolver. Besides the positions
+	 * and the link lengths, the model provides solveAssembly(index, x, y), which
+	 * places the end effector of an assembly at the current phases, and
+	 * failure(status), which completes the status of a failed solve. The solve stops
+	 * at the first failure.
+	 */
+	template<typename Model>
+	inline SolveStatus solveForward(const Kinematics& design, Model& model) {
+		for (int i = 0; i < design.assemblies.size(); ++i) {
+			int point = design.assemblies[i]->end_effector;
+			if (!model.solveAssembly(i, model.x[point], model.y[point])) return model.failure(design.assemblyFailure(i));
+		}
+
+		for (int i = 0; i < design.solve_schedule.size(); ++i) {
+			if (!solveDyad(model, design.solve_schedule[i])) return model.failure(design.dyadFailure(design.solve_schedule[i]));
+		}
+
+		return SolveStatus();
+	}
+
+	/**
+	 * Forward kinematics of a compiled design in an arbitrary scalar type, e.g.,
+	 * double for synthesis and validation, or Dual<double> for exact derivatives.
+	 * The topology and the solve schedule are taken from the design, and the
+	 * parameters (the link lengths, the link lengths of the assemblies, and the
+	 * center, radius, phase and speed of the gears) are copied into one flat array,
+	 * so that an optimizer can change or differentiate any of them by index.
+	 * The points that are not solved (e.g., the ground points) keep their positions
+	 * in the design.
+	 * The phases are advanced by copies of the phase clocks of the design, in the
+	 * same way as Kinematics steps them, so that the same design is solved at the
+	 * same phases. A phase parameter that has been changed is applied as a rotation
+	 * of the rotor of its clock.
+	 */
+	template<typename T>
+	class KinematicsSolver {
+	public:
+		enum { CENTER_X = 0, CENTER_Y, RADIUS, PHASE, SPEED, NUM_GEAR_PARAMS };
+
+		const Kinematics* design;
+		std::vector<T> params;
+		std::vector<int> assembly_offsets;
+		std::vector<T> x;
+		std::vector<T> y;
+		double time;
+
+		// the phase clocks of the assemblies and their gears in the layout of the frame
+		// cache, and the phases that they keep
+		std::vector<PhaseClock> clocks;
+		std::vector<int> clock_offsets;
+		std::vector<T> clock_phases;
+
+	public:
+		KinematicsSolver(const Kinematics& design) : design(&design), time(0) {
+			for (int i = 0; i < design.links.size(); ++i) {
+				params.push_back(T(design.links[i].length));
+			}
+			for (int i = 0; i < design.assemblies.size(); ++i) {
+				const MechanicalAssembly& ass = *design.assemblies[i];
+				assembly_offsets.push_back(params.size());
+				for (int k = 0; k < ass.link_lengths.size(); ++k) {
+					params.push_back(T(ass.link_lengths[k]));
+				}
+				for (int j = 0; j < ass.gears.size(); ++j) {
+					params.push_back(T(ass.gears[j].center.x));
+					params.push_back(T(ass.gears[j].center.y));
+					params.push_back(T(ass.gears[j].radius));
+					params.push_back(T(ass.gears[j].phase));
+					params.push_back(T(ass.gears[j].speed));
+				}
+
+				clock_offsets.push_back(clocks.size());
+				clocks.push_back(ass.clock);
+				clock_phases.push_back(T(ass.phase));
+				for (int j = 0; j < ass.gears.size(); ++j) {
+					clocks.push_back(ass.gears[j].clock);
+					clock_phases.push_back(T(ass.gears[j].phase));
+				}
+			}
+
+			x.assign(design.points.x.begin(), design.points.x.end());
+			y.assign(design.points.y.begin(), design.points.y.end());
+		}
+
+		int numParams() const { return params.size(); }
+		int linkLengthParam(int link) const { return link; }
+		int assemblyLinkLengthParam(int assembly, int k) const { return assembly_offsets[assembly] + k; }
+		int gearParam(int assembly, int gear, int field) const { return assembly_offsets[assembly] + design->assemblies[assembly]->link_lengths.size() + gear * NUM_GEAR_PARAMS + field; }
+		int clockIndex(int assembly, int gear) const { return clock_offsets[assembly] + 1 + gear; }
+
+		/**
+		 * Advance the phases of all the gears by their speeds times the time step. The
+		 * clocks are advanced as MechanicalAssembly::forward() does, and the phase
+		 * parameters by the same amount, so that they carry the derivatives.
+		 */
+		void advance(double time_step) {
+			for (int i = 0; i < design->assemblies.size(); ++i) {
+				// the assembly phase advances at speed 1
+				clocks[clockIndex(i, -1)].advance(time_step);
+				clock_phases[clockIndex(i, -1)] += T(time_step);
+
+				for (int j = 0; j < design->assemblies[i]->gears.size(); ++j) {
+					T* gear = &params[gearParam(i, j, 0)];
+					clocks[clockIndex(i, j)].advance((double)value(gear[SPEED]) * time_step);
+					clock_phases[clockIndex(i, j)] += T(value(gear[SPEED])) * T(time_step);
+					gear[PHASE] += gear[SPEED] * T(time_step);
+				}
+			}
+			time += time_step;
+		}
+
+		/**
+		 * Solve the end effectors of the assemblies and then the points in the order of
+		 * the schedule, by the same routine as Kinematics::forwardKinematics().
+		 */
+		SolveStatus forwardKinematics() {
+			return solveForward(*design, *this);
+		}
+
+		T linkLength(int link) const {
+			return params[link];
+		}
+
+		bool solveAssembly(int index, T& end_x, T& end_y) const {
+			const MechanicalAssembly& ass = *design->assemblies[index];
+			const T* lengths = &params[assembly_offsets[index]];
+			T x0, y0, x1, y1, x2, y2, joint_x, joint_y;
+			linkEnd(index, 0, x0, y0);
+			linkEnd(index, ass.order.first, x1, y1);
+			linkEnd(index, ass.order.second, x2, y2);
+			return assemblyPositions(x0, y0, x1, y1, lengths[ass.order.first], x2, y2, lengths[ass.order.second], lengths[0], lengths[2], joint_x, joint_y, end_x, end_y);
+		}
+
+		SolveStatus failure(SolveStatus status) const {
+			status.phase = clocks.empty() ? 0 : clocks[0].radians();
+			return status;
+		}
+
+	private:
+		void linkEnd(int assembly, int gear, T& x, T& y) const {
+			const T* p = &params[gearParam(assembly, gear, 0)];
+			T rotor_x, rotor_y;
+			phaseRotor(clocks[clockIndex(assembly, gear)].rotor, p[PHASE] - clock_phases[clockIndex(assembly, gear)], rotor_x, rotor_y);
+			linkEndPosition(p[CENTER_X], p[CENTER_Y], p[RADIUS], rotor_x, rotor_y, x, y);
+		}
+	};
+
+	/**
+	 * Make the dual parts of a dual-number solver hold the derivatives with respect
+	 * to the given parameter, so that after forwardKinematics() the dual parts of the
+	 * positions are the exact derivatives of the points. The full Jacobian takes one
+	 * pass per parameter.
+	 */
+	template<typename S>
+	inline void seedParam(KinematicsSolver<Dual<S>>& solver, int param) {
+		for (int i = 0; i < solver.params.size(); ++i) {
+			solver.params[i].d = i == param ? S(1) : S(0);
+		}
+	}
+}
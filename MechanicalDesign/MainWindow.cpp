@@ -7,6 +7,7 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
 	ui.actionShowAssemblies->setChecked(true);
 	ui.actionShowLinks->setChecked(true);
 	ui.actionShowBodies->setChecked(true);
+	ui.actionWatchFile->setChecked(true);
 
 	setCentralWidget(&canvas);
 	phaseControlWidget = new PhaseControlWidget(this);
@@ -16,33 +17,49 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
 	connect(ui.actionExit, SIGNAL(triggered()), this, SLOT(close()));
 	connect(ui.actionRun, SIGNAL(triggered()), this, SLOT(onRun()));
 	connect(ui.actionStop, SIGNAL(triggered()), this, SLOT(onStop()));
+	connect(ui.actionSimulationThread, SIGNAL(triggered()), this, SLOT(onSimulationThread()));
 	connect(ui.actionPhaseControl, SIGNAL(triggered()), this, SLOT(onPhaseControl()));
 	connect(ui.actionShowAll, SIGNAL(triggered()), this, SLOT(onShowAll()));
 	connect(ui.actionShowAssemblies, SIGNAL(triggered()), this, SLOT(onShowChanged()));
 	connect(ui.actionShowLinks, SIGNAL(triggered()), this, SLOT(onShowChanged()));
 	connect(ui.actionShowBodies, SIGNAL(triggered()), this, SLOT(onShowChanged()));
+	connect(ui.actionFadeTraces, SIGNAL(triggered()), this, SLOT(onShowChanged()));
+	connect(ui.actionWatchFile, SIGNAL(triggered()), this, SLOT(onWatchChanged()));
+	connect(ui.actionWatchDirectory, SIGNAL(triggered()), this, SLOT(onWatchChanged()));
+	connect(&canvas, SIGNAL(designLoaded()), this, SLOT(onDesignLoaded()));
 }
 
 MainWindow::~MainWindow() {
 }
 
 void MainWindow::onOpen() {
-	QString filename = QFileDialog::getOpenFileName(this, tr("Open Design file..."), "", tr("Design Files (*.xml)"));
+	QString filename = QFileDialog::getOpenFileName(this, tr("Open Design file..."), "", tr("Design Files (*.xml *.mdb)"));
 	if (filename.isEmpty()) return;
 
 	try {
 		canvas.open(filename);
 	}
-	catch (char* ex) {
+	catch (const char* ex) {
+		QMessageBox::warning(this, "Error message", ex);
+	}
+	catch (const QString& ex) {
 		QMessageBox::warning(this, "Error message", ex);
 	}
 }
 
 void MainWindow::onSave() {
-	QString filename = QFileDialog::getSaveFileName(this, tr("Save Design file..."), "", tr("Design Files (*.xml)"));
+	QString filename = QFileDialog::getSaveFileName(this, tr("Save Design file..."), "", tr("Design Files (*.xml *.mdb)"));
 	if (filename.isEmpty()) return;
 
-	canvas.save(filename);
+	try {
+		canvas.save(filename);
+	}
+	catch (const char* ex) {
+		QMessageBox::warning(this, "Error message", ex);
+	}
+	catch (const QString& ex) {
+		QMessageBox::warning(this, "Error message", ex);
+	}
 }
 
 void MainWindow::onRun() {
@@ -53,6 +70,10 @@ void MainWindow::onStop() {
 	canvas.stop();
 }
 
+void MainWindow::onSimulationThread() {
+	canvas.setSimulationThread(ui.actionSimulationThread->isChecked());
+}
+
 void MainWindow::onPhaseControl() {
 	phaseControlWidget->setAssemblies(canvas.kinematics.assemblies);
 	phaseControlWidget->show();
@@ -73,5 +94,17 @@ void MainWindow::onShowChanged() {
 	canvas.showAssemblies(ui.actionShowAssemblies->isChecked());
 	canvas.showLinks(ui.actionShowLinks->isChecked());
 	canvas.showBodies(ui.actionShowBodies->isChecked());
+	canvas.fadeTraces(ui.actionFadeTraces->isChecked());
 }
 
+void MainWindow::onWatchChanged() {
+	canvas.watchFile(ui.actionWatchFile->isChecked());
+	canvas.watchDirectory(ui.actionWatchDirectory->isChecked());
+}
+
+/**
+ * Rebuild the phase sliders for the design that has been opened or reloaded.
+ */
+void MainWindow::onDesignLoaded() {
+	phaseControlWidget->setAssemblies(canvas.kinematics.assemblies);
+}
@@ -25,9 +25,12 @@ public slots:
 	void onSave();
 	void onRun();
 	void onStop();
+	void onSimulationThread();
 	void onPhaseControl();
 	void onShowAll();
 	void onShowChanged();
+	void onWatchChanged();
+	void onDesignLoaded();
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,83 @@
+#include "OverlayPainter.h"
+
+namespace {
+	// created once so that painting the overlays does not allocate pens per frame
+	const QPen PREVIEW_PEN(QColor(128, 128, 128), 1, Qt::DashLine);
+	const QPen HIGHLIGHT_PEN(QColor(255, 128, 0), 2);
+	const QPen HIGHLIGHT_LINK_PEN(QColor(255, 128, 0), 5);
+	const QRgb FEASIBLE_COLOR = qPremultiply(qRgba(0, 192, 0, 40));
+}
+
+/**
+ * Render a feasibility level into an image of one pixel per cell, green where the
+ * mechanism runs through the whole cycle with the dragged gear centered there, and
+ * red where it fails, darker the earlier it fails. This is done once per level, and
+ * the image is reused by the next level of the same size.
+ */
+void OverlayPainter::setFeasibility(const FeasibilityLevel& level) {
+	if (feasibility_image.width() != level.size || feasibility_image.height() != level.size) {
+		feasibility_image = QImage(level.size, level.size, QImage::Format_ARGB32_Premultiplied);
+	}
+
+	for (int j = 0; j < level.size; ++j) {
+		QRgb* line = reinterpret_cast<QRgb*>(feasibility_image.scanLine(j));
+		for (int i = 0; i < level.size; ++i) {
+			float v = level.value(i, j);
+			line[i] = v >= 1 ? FEASIBLE_COLOR : qPremultiply(qRgba(255, 0, 0, 40 + (1 - v) * 100));
+		}
+	}
+
+	feasibility_rect = QRectF(level.origin.x, level.origin.y, level.size * level.cell_size, level.size * level.cell_size);
+}
+
+void OverlayPainter::clearFeasibility() {
+	feasibility_rect = QRectF();
+}
+
+/**
+ * Draw the latest feasibility level scaled up to its cells, without smoothing, so
+ * that a repaint costs a single image draw however fine the level is.
+ */
+void OverlayPainter::drawFeasibility(QPainter& painter) {
+	if (feasibility_rect.isEmpty()) return;
+
+	painter.drawImage(feasibility_rect, feasibility_image);
+}
+
+void OverlayPainter::drawPreview(QPainter& painter, const std::vector<RingBuffer<glm::vec2>>& trajectories) {
+	for (int i = 0; i < trajectories.size(); ++i) {
+		preview_painter.draw(painter, trajectories[i], PREVIEW_PEN);
+	}
+}
+
+/**
+ * Outline the item. The pen and the brush of the painter are left changed, since
+ * saving and restoring its state allocates.
+ */
+void OverlayPainter::drawHighlight(QPainter& painter, const kinematics::Kinematics& kinematics, const kinematics::PickItem& item) {
+	painter.setPen(HIGHLIGHT_PEN);
+	painter.setBrush(Qt::NoBrush);
+
+	if (item.type == kinematics::PickItem::JOINT) {
+		glm::vec2 p = kinematics.points.pos(item.index);
+		painter.drawEllipse(QPointF(p.x, p.y), 6, 6);
+	}
+	else if (item.type == kinematics::PickItem::LINK) {
+		glm::vec2 p1 = kinematics.points.pos(kinematics.links[item.index].start);
+		glm::vec2 p2 = kinematics.points.pos(kinematics.links[item.index].end);
+		painter.setPen(HIGHLIGHT_LINK_PEN);
+		painter.drawLine(QPointF(p1.x, p1.y), QPointF(p2.x, p2.y));
+	}
+	else if (item.type == kinematics::PickItem::GEAR) {
+		const kinematics::Gear& gear = kinematics.assemblies[item.index]->gears[item.sub];
+		painter.drawEllipse(QPointF(gear.center.x, gear.center.y), gear.radius, gear.radius);
+	}
+	else if (item.type == kinematics::PickItem::BODY) {
+		kinematics::bodyPolygon(kinematics, item.index, polygon);
+		outline.resize(0);
+		for (int k = 0; k < polygon.size(); ++k) {
+			outline.append(QPointF(polygon[k].x, polygon[k].y));
+		}
+		painter.drawPolygon(outline.constData(), outline.size());
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QPainter>
+#include <QImage>
+#include <QPolygonF>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Kinematics.h"
+#include "PickIndex.h"
+#include "FeasibilityMap.h"
+#include "RingBuffer.h"
+#include "TracePainter.h"
+
+/**
+ * Draw what the canvas shows over and under the mechanism: the feasibility of the
+ * dragged gear, the previewed trajectories, and the highlight of the item under
+ * the mouse. The buffers are kept between calls, so that painting does not
+ * allocate on every frame.
+ */
+class OverlayPainter {
+private:
+	TracePainter preview_painter;
+	std::vector<glm::vec2> polygon;
+	QPolygonF outline;
+
+	// the latest feasibility level, one pixel per cell, and where it is drawn
+	QImage feasibility_image;
+	QRectF feasibility_rect;
+
+public:
+	OverlayPainter() {}
+
+	void setFeasibility(const FeasibilityLevel& level);
+	void clearFeasibility();
+	void drawFeasibility(QPainter& painter);
+	void drawPreview(QPainter& painter, const std::vector<RingBuffer<glm::vec2>>& trajectories);
+	void drawHighlight(QPainter& painter, const kinematics::Kinematics& kinematics, const kinematics::PickItem& item);
+};
@@ -6,6 +6,11 @@
 PhaseControlWidget::PhaseControlWidget(MainWindow *parent) : QDockWidget("Phase Control") {
 	mainWin = parent;
 	ui.setupUi(this);
+
+	// the slider changes are applied at most once per frame
+	update_timer.setSingleShot(true);
+	update_timer.setInterval(16);
+	connect(&update_timer, SIGNAL(timeout()), this, SLOT(onUpdate()));
 }
 
 PhaseControlWidget::~PhaseControlWidget() {
@@ -20,6 +25,7 @@ void PhaseControlWidget::setAssemblies(std::vector<boost::shared_ptr<kinematics:
 	sliders.clear();
 
 	this->assemblies = assemblies;
+	moved.assign(assemblies.size(), 0);
 
 	// add sliders
 	for (int i = 0; i < assemblies.size(); ++i) {
@@ -36,10 +42,41 @@ void PhaseControlWidget::setAssemblies(std::vector<boost::shared_ptr<kinematics:
 
 void PhaseControlWidget::onValueChanged(int value) {
 	for (int i = 0; i < sliders.size(); ++i) {
-		float target_phase = (float)sliders[i]->value() * 0.01;
+		if (sliders[i] == sender()) moved[i] = 1;
+	}
+
+	if (!update_timer.isActive()) update_timer.start();
+}
+
+/**
+ * Apply the slider changes made since the last update. Only the assemblies whose
+ * sliders moved are updated together with their downstream points, and the
+ * trajectories for the new phases are previewed in the background.
+ */
+void PhaseControlWidget::onUpdate() {
+	// the phases cannot be changed while the simulation thread owns the state
+	bool running = mainWin->canvas.stopSimulationThread();
+
+	for (int i = 0; i < sliders.size(); ++i) {
+		if (!moved[i]) continue;
+		moved[i] = 0;
+
+		// the sliders may still belong to a design that has been replaced
+		if (i >= mainWin->canvas.kinematics.assemblies.size() || mainWin->canvas.kinematics.assemblies[i] != assemblies[i]) continue;
 
+		float target_phase = (float)sliders[i]->value() * 0.01;
 		assemblies[i]->forward(target_phase - assemblies[i]->phase);
+		mainWin->canvas.kinematics.markAssemblyDirty(i);
 	}
-	mainWin->canvas.kinematics.forwardKinematics();
+
+	kinematics::SolveStatus status = mainWin->canvas.kinematics.forwardKinematicsIncremental();
+	if (!status.ok()) {
+		std::cerr << "Phase control error:" << std::endl;
+		std::cerr << status.message().toUtf8().constData() << std::endl;
+	}
+	mainWin->canvas.kinematics.invalidateFrameCache();
+
+	if (running) mainWin->canvas.startSimulationThread();
+	else mainWin->canvas.startPreview();
 	mainWin->canvas.update();
-}
\ No newline at end of file
+}
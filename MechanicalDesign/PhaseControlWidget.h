@@ -2,6 +2,7 @@
 #define PHASECONTROLWIDGET_H
 
 #include <QDockWidget>
+#include <QTimer>
 #include "ui_PhaseControlWidget.h"
 #include "Kinematics.h"
 
@@ -16,6 +17,8 @@ public:
 	std::vector<QSlider*> sliders;
 	MainWindow* mainWin;
 	std::vector<boost::shared_ptr<kinematics::MechanicalAssembly>> assemblies;
+	std::vector<unsigned char> moved;
+	QTimer update_timer;
 
 public:
 	PhaseControlWidget(MainWindow *parent = 0);
@@ -25,6 +28,7 @@ public:
 
 public slots:
 	void onValueChanged(int value);
+	void onUpdate();
 };
 
 #endif // PHASECONTROLWIDGET_H
@@ -0,0 +1,227 @@
+#include "PickIndex.h"
+#include "Kinematics.h"
+#include <algorithm>
+#include <limits>
+
+namespace kinematics {
+
+	namespace {
+		float segmentDistance(const glm::vec2& pt, const glm::vec2& a, const glm::vec2& b) {
+			glm::vec2 ab = b - a;
+			float len2 = glm::dot(ab, ab);
+			float t = len2 > 0 ? glm::clamp(glm::dot(pt - a, ab) / len2, 0.0f, 1.0f) : 0.0f;
+			return glm::length(a + ab * t - pt);
+		}
+
+		// 0 inside the polygon, and the distance to the boundary outside
+		float polygonDistance(const glm::vec2& pt, const std::vector<glm::vec2>& polygon) {
+			bool inside = false;
+			float dist = std::numeric_limits<float>::max();
+			for (int i = 0, j = (int)polygon.size() - 1; i < polygon.size(); j = i++) {
+				const glm::vec2& a = polygon[i];
+				const glm::vec2& b = polygon[j];
+				if ((a.y > pt.y) != (b.y > pt.y) && pt.x < (b.x - a.x) * (pt.y - a.y) / (b.y - a.y) + a.x) inside = !inside;
+				dist = std::min(dist, segmentDistance(pt, a, b));
+			}
+
+			return inside ? 0 : dist;
+		}
+	}
+
+	/**
+	 * Compute the vertices of a body in the world coordinates, in the same way as
+	 * it is drawn.
+	 */
+	void bodyPolygon(const Kinematics& kinematics, int index, std::vector<glm::vec2>& polygon) {
+		const Part& body = kinematics.bodies[index];
+		glm::vec2 p1 = kinematics.points.pos(body.pivot1);
+		glm::vec2 p2 = kinematics.points.pos(body.pivot2);
+		glm::vec2 dir = p2 - p1;
+		float angle = atan2f(dir.y, dir.x);
+		float c = cosf(angle);
+		float s = sinf(angle);
+		glm::vec2 center = (p1 + p2) * 0.5f;
+
+		polygon.resize(body.points.size());
+		for (int k = 0; k < body.points.size(); ++k) {
+			const glm::vec2& p = body.points[k];
+			polygon[k] = center + glm::vec2(p.x * c - p.y * s, p.x * s + p.y * c);
+		}
+	}
+
+	void PickIndex::clear() {
+		grid.clear();
+		items.clear();
+		kinematics = NULL;
+		revision = -1;
+	}
+
+	/**
+	 * Bring the index up to date with the design. The items are listed again only
+	 * if the design has changed its structure, and otherwise the boxes of the items
+	 * that have moved are updated.
+	 */
+	void PickIndex::refresh(const Kinematics& kinematics) {
+		if (this->kinematics == &kinematics && revision == kinematics.revision) return;
+		revision = kinematics.revision;
+
+		int num_gears = 0;
+		for (int i = 0; i < kinematics.assemblies.size(); ++i) {
+			num_gears += kinematics.assemblies[i]->gears.size();
+		}
+		glm::ivec4 new_counts(kinematics.points.size(), kinematics.links.size(), num_gears, kinematics.bodies.size());
+		if (this->kinematics != &kinematics || new_counts != counts) {
+			grid.clear();
+			this->kinematics = &kinematics;
+			counts = new_counts;
+			rebuildItems();
+
+			// nothing is known to be in place, so every item is registered
+			x.assign(counts.x, std::numeric_limits<float>::quiet_NaN());
+			y.assign(counts.x, std::numeric_limits<float>::quiet_NaN());
+			gears.assign(counts.z, glm::vec3(std::numeric_limits<float>::quiet_NaN()));
+		}
+
+		const PointStore& points = kinematics.points;
+		moved.assign(points.size(), 0);
+		for (int i = 0; i < points.size(); ++i) {
+			if (points.x[i] == x[i] && points.y[i] == y[i]) continue;
+			x[i] = points.x[i];
+			y[i] = points.y[i];
+			moved[i] = 1;
+			updateItem(i);
+		}
+
+		int id = counts.x;
+		for (int i = 0; i < kinematics.links.size(); ++i, ++id) {
+			if (moved[kinematics.links[i].start] || moved[kinematics.links[i].end]) updateItem(id);
+		}
+
+		for (int i = 0; i < kinematics.assemblies.size(); ++i) {
+			for (int j = 0; j < kinematics.assemblies[i]->gears.size(); ++j, ++id) {
+				const Gear& gear = kinematics.assemblies[i]->gears[j];
+				glm::vec3 circle(gear.center, gear.radius);
+				if (circle == gears[id - counts.x - counts.y]) continue;
+				gears[id - counts.x - counts.y] = circle;
+				updateItem(id);
+			}
+		}
+
+		for (int i = 0; i < kinematics.bodies.size(); ++i, ++id) {
+			if (moved[kinematics.bodies[i].pivot1] || moved[kinematics.bodies[i].pivot2]) updateItem(id);
+		}
+	}
+
+	/**
+	 * Return the item nearest to the point among the given types, which has to be
+	 * within the tolerance. A point inside a gear or a body is at distance 0 from it.
+	 */
+	PickItem PickIndex::pick(const Kinematics& kinematics, const glm::vec2& pt, float tolerance, int types) {
+		refresh(kinematics);
+
+		int id = grid.nearest(pt, tolerance, [&](int id) {
+			if (!(items[id].type & types)) return std::numeric_limits<float>::max();
+			return distance(id, pt);
+		});
+
+		return id >= 0 ? items[id] : PickItem();
+	}
+
+	/**
+	 * Return the items of the given types that lie entirely within the rectangle.
+	 */
+	void PickIndex::select(const Kinematics& kinematics, const glm::vec2& min, const glm::vec2& max, std::vector<PickItem>& selected, int types) {
+		refresh(kinematics);
+
+		selected.clear();
+		grid.query(min, max, candidates);
+		std::sort(candidates.begin(), candidates.end());
+		for (int i = 0; i < candidates.size(); ++i) {
+			int id = candidates[i];
+			if (!(items[id].type & types)) continue;
+
+			glm::vec2 box_min = grid.boxMin(id);
+			glm::vec2 box_max = grid.boxMax(id);
+			if (box_min.x >= min.x && box_min.y >= min.y && box_max.x <= max.x && box_max.y <= max.y) selected.push_back(items[id]);
+		}
+	}
+
+	float PickIndex::distance(int id, const glm::vec2& pt) {
+		const PickItem& item = items[id];
+		switch (item.type) {
+		case PickItem::JOINT:
+			return glm::length(kinematics->points.pos(item.index) - pt);
+		case PickItem::LINK:
+			return segmentDistance(pt, kinematics->points.pos(kinematics->links[item.index].start), kinematics->points.pos(kinematics->links[item.index].end));
+		case PickItem::GEAR:
+			{
+				const Gear& gear = kinematics->assemblies[item.index]->gears[item.sub];
+				return std::max(0.0f, glm::length(gear.center - pt) - gear.radius);
+			}
+		default:
+			bodyPolygon(*kinematics, item.index, polygon);
+			return polygonDistance(pt, polygon);
+		}
+	}
+
+	/**
+	 * List the items. The small ones come first, so that they win the ties, e.g.,
+	 * a joint on top of a gear.
+	 */
+	void PickIndex::rebuildItems() {
+		items.clear();
+		for (int i = 0; i < kinematics->points.size(); ++i) {
+			items.push_back(PickItem(PickItem::JOINT, i));
+		}
+		for (int i = 0; i < kinematics->links.size(); ++i) {
+			items.push_back(PickItem(PickItem::LINK, i));
+		}
+		for (int i = 0; i < kinematics->assemblies.size(); ++i) {
+			for (int j = 0; j < kinematics->assemblies[i]->gears.size(); ++j) {
+				items.push_back(PickItem(PickItem::GEAR, i, j));
+			}
+		}
+		for (int i = 0; i < kinematics->bodies.size(); ++i) {
+			items.push_back(PickItem(PickItem::BODY, i));
+		}
+	}
+
+	void PickIndex::updateItem(int id) {
+		glm::vec2 min, max;
+		itemBox(id, min, max);
+		grid.update(id, min, max);
+	}
+
+	void PickIndex::itemBox(int id, glm::vec2& min, glm::vec2& max) {
+		const PickItem& item = items[id];
+		switch (item.type) {
+		case PickItem::JOINT:
+			min = max = kinematics->points.pos(item.index);
+			break;
+		case PickItem::LINK:
+			{
+				glm::vec2 a = kinematics->points.pos(kinematics->links[item.index].start);
+				glm::vec2 b = kinematics->points.pos(kinematics->links[item.index].end);
+				min = glm::min(a, b);
+				max = glm::max(a, b);
+			}
+			break;
+		case PickItem::GEAR:
+			{
+				const Gear& gear = kinematics->assemblies[item.index]->gears[item.sub];
+				min = gear.center - glm::vec2(gear.radius, gear.radius);
+				max = gear.center + glm::vec2(gear.radius, gear.radius);
+			}
+			break;
+		default:
+			bodyPolygon(*kinematics, item.index, polygon);
+			min = max = polygon.empty() ? kinematics->points.pos(kinematics->bodies[item.index].pivot1) : polygon[0];
+			for (int k = 1; k < polygon.size(); ++k) {
+				min = glm::min(min, polygon[k]);
+				max = glm::max(max, polygon[k]);
+			}
+			break;
+		}
+	}
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "UniformGrid.h"
+
+namespace kinematics {
+	class Kinematics;
+
+	/**
+	 * An element of the mechanism that can be picked with the mouse. For a gear,
+	 * index is the assembly and sub is the gear in it. For the others, index is the
+	 * point, link, or body.
+	 */
+	class PickItem {
+	public:
+		enum { NONE = 0, JOINT = 1, LINK = 2, GEAR = 4, BODY = 8, ALL = 15 };
+
+		int type;
+		int index;
+		int sub;
+
+	public:
+		PickItem() : type(NONE), index(-1), sub(-1) {}
+		PickItem(int type, int index, int sub = -1) : type(type), index(index), sub(sub) {}
+
+		bool operator==(const PickItem& other) const { return type == other.type && index == other.index && sub == other.sub; }
+		bool operator!=(const PickItem& other) const { return !(*this == other); }
+	};
+
+	/**
+	 * Spatial index of the joints, links, gears, and bodies of a design for picking.
+	 * It is refreshed lazily by the queries when the revision of the design has
+	 * changed. Only the boxes of the items whose joints or gears have moved since
+	 * the last refresh are computed again, and only the items that moved to other
+	 * grid cells are re-registered. It has to be cleared when the body outlines
+	 * change, or another design of the same size is loaded.
+	 */
+	class PickIndex {
+	public:
+		UniformGrid grid;
+		std::vector<PickItem> items;
+		const Kinematics* kinematics;
+		int revision;
+		glm::ivec4 counts;
+		std::vector<glm::vec2> polygon;
+		std::vector<int> candidates;
+
+		// the joints and gears as of the last refresh
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<glm::vec3> gears;
+		std::vector<unsigned char> moved;
+
+	public:
+		PickIndex() : kinematics(NULL), revision(-1) {}
+
+		void clear();
+		void refresh(const Kinematics& kinematics);
+		PickItem pick(const Kinematics& kinematics, const glm::vec2& pt, float tolerance, int types = PickItem::ALL);
+		void select(const Kinematics& kinematics, const glm::vec2& min, const glm::vec2& max, std::vector<PickItem>& selected, int types = PickItem::ALL);
+		float distance(int id, const glm::vec2& pt);
+
+	private:
+		void rebuildItems();
+		void updateItem(int id);
+		void itemBox(int id, glm::vec2& min, glm::vec2& max);
+	};
+
+	void bodyPolygon(const Kinematics& kinematics, int index, std::vector<glm::vec2>& polygon);
+}
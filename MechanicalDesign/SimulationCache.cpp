@@ -0,0 +1,283 @@
+#include "SimulationCache.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <cstring>
+
+namespace kinematics {
+
+	namespace {
+		const float PI = 3.141592653f;
+
+		// the oldest entries are removed once the entries take more than this many bytes
+		const qint64 DEFAULT_MAX_SIZE = 256 * 1024 * 1024;
+
+		// bump whenever the solver changes its results, so that the entries written by older versions are not used
+		const unsigned int SOLVER_VERSION = 1;
+
+		/**
+		 * Cache entry file (*.cycle).
+		 * A header is followed by a payload of the arrays below in this order, in the
+		 * native layout, since the entries are only read by the machine that wrote them.
+		 * The entries are written atomically, so a payload of the expected size is complete.
+		 *   frame phase clocks       PhaseClock[num_frames * num_phases]
+		 *   end-effector positions   glm::vec2[(num_steps + 1) * num_assemblies]
+		 *   frame point positions    float[num_frames * num_points] (x), and then (y)
+		 *   solved steps             unsigned char[num_steps + 1]
+		 *   recorded frames          unsigned char[num_frames]
+		 */
+		const char CACHE_MAGIC[4] = { 'M', 'D', 'C', 'Y' };
+		const unsigned int CACHE_VERSION = 1;
+
+		struct CacheHeader {
+			char magic[4];
+			unsigned int version;
+			unsigned int solver_version;
+			unsigned int payload_size;
+			unsigned long long hash;
+			int num_steps;
+			int num_assemblies;
+			int failure_code;
+			int failure_point;
+			int failure_link1;
+			int failure_link2;
+			int failure_assembly;
+			float failure_phase;
+			int failure_step;
+			int num_failed_steps;
+			int num_frames;
+			int num_points;
+			int num_phases;
+		};
+
+		/**
+		 * Return a pointer to the next n elements of type T of the mapped payload, or
+		 * NULL if the payload is too short.
+		 */
+		template<typename T>
+		const T* takeArray(const unsigned char*& ptr, const unsigned char* end, int n) {
+			if (n < 0 || (size_t)(end - ptr) < sizeof(T) * n) return NULL;
+			const T* ret = reinterpret_cast<const T*>(ptr);
+			ptr += sizeof(T) * n;
+			return ret;
+		}
+
+		template<typename T>
+		void writeArray(QSaveFile& file, const std::vector<T>& data) {
+			if (data.empty()) return;
+			file.write(reinterpret_cast<const char*>(data.data()), sizeof(T) * data.size());
+		}
+
+		bool readEntry(const unsigned char* data, qint64 size, unsigned long long hash, CycleResult& result) {
+			const CacheHeader* header = reinterpret_cast<const CacheHeader*>(data);
+			if (memcmp(header->magic, CACHE_MAGIC, 4) != 0) return false;
+			if (header->version != CACHE_VERSION || header->solver_version != SOLVER_VERSION || header->hash != hash) return false;
+			if (header->payload_size != size - sizeof(CacheHeader)) return false;
+			if (header->num_steps < 0 || header->num_assemblies < 0 || header->num_frames < 0 || header->num_points < 0 || header->num_phases < 0) return false;
+
+			const unsigned char* ptr = data + sizeof(CacheHeader);
+			const unsigned char* end = data + size;
+			int num_steps = header->num_steps + 1;
+			const PhaseClock* phases = takeArray<PhaseClock>(ptr, end, header->num_frames * header->num_phases);
+			const glm::vec2* end_effectors = takeArray<glm::vec2>(ptr, end, num_steps * header->num_assemblies);
+			const float* x = takeArray<float>(ptr, end, header->num_frames * header->num_points);
+			const float* y = takeArray<float>(ptr, end, header->num_frames * header->num_points);
+			const unsigned char* solved = takeArray<unsigned char>(ptr, end, num_steps);
+			const unsigned char* recorded = takeArray<unsigned char>(ptr, end, header->num_frames);
+			if (phases == NULL || end_effectors == NULL || x == NULL || y == NULL || solved == NULL || recorded == NULL || ptr != end) return false;
+
+			result.num_steps = header->num_steps;
+			result.num_assemblies = header->num_assemblies;
+			result.solved.assign(solved, solved + num_steps);
+			result.end_effectors.assign(end_effectors, end_effectors + num_steps * header->num_assemblies);
+			result.failure.code = header->failure_code;
+			result.failure.point = header->failure_point;
+			result.failure.link1 = header->failure_link1;
+			result.failure.link2 = header->failure_link2;
+			result.failure.assembly = header->failure_assembly;
+			result.failure.phase = header->failure_phase;
+			result.failure_step = header->failure_step;
+			result.num_failed_steps = header->num_failed_steps;
+
+			result.frames.num_frames = header->num_frames;
+			result.frames.num_points = header->num_points;
+			result.frames.num_phases = header->num_phases;
+			result.frames.x.assign(x, x + header->num_frames * header->num_points);
+			result.frames.y.assign(y, y + header->num_frames * header->num_points);
+			result.frames.phases.assign(phases, phases + header->num_frames * header->num_phases);
+			result.frames.recorded.assign(recorded, recorded + header->num_frames);
+
+			return true;
+		}
+	}
+
+	/**
+	 * Take over the recorded frames into the frame cache of the design, which has to
+	 * be in its loaded state, so that its frames are restored instead of solved.
+	 * Returns false if the frames do not fit the design.
+	 */
+	bool CycleResult::applyFrames(Kinematics& kinematics) const {
+		const FrameCache& cache = kinematics.frame_cache;
+		if (frames.num_frames != cache.num_frames || frames.num_points != cache.num_points || frames.num_phases != cache.num_phases) return false;
+
+		kinematics.frame_cache = frames;
+		return true;
+	}
+
+	/**
+	 * Simulate one full cycle of a copy of the design from its phases as loaded. The
+	 * simulation continues past the steps that cannot be solved, which are counted,
+	 * and the first of them is kept.
+	 */
+	void simulateCycle(const Kinematics& design, CycleResult& result) {
+		Kinematics kinematics;
+		design.copyTo(kinematics);
+		kinematics.rewind();
+
+		float period = kinematics.cyclePeriod();
+		if (period == 0) period = PI * 2;
+		result.num_steps = ceilf(period / kinematics.time_step);
+		result.num_assemblies = kinematics.assemblies.size();
+		result.solved.assign(result.num_steps + 1, 0);
+		result.end_effectors.assign((result.num_steps + 1) * result.num_assemblies, glm::vec2(0, 0));
+		result.failure = SolveStatus();
+		result.failure_step = -1;
+		result.num_failed_steps = 0;
+
+		SolveStatus status = kinematics.forwardKinematics();
+		for (int step = 0; step <= result.num_steps; ++step) {
+			if (step > 0) status = kinematics.stepForward();
+
+			if (!status.ok()) {
+				if (result.num_failed_steps++ == 0) {
+					result.failure = status;
+					result.failure_step = step;
+				}
+				continue;
+			}
+
+			result.solved[step] = 1;
+			for (int i = 0; i < result.num_assemblies; ++i) {
+				result.end_effectors[step * result.num_assemblies + i] = kinematics.points.pos(kinematics.assemblies[i]->end_effector);
+			}
+		}
+
+		result.frames = kinematics.frame_cache;
+	}
+
+	SimulationCache::SimulationCache(const QString& path) : path(path), max_size(DEFAULT_MAX_SIZE) {
+	}
+
+	/**
+	 * The cache directory shared by the GUI and the batch tools.
+	 */
+	QString SimulationCache::defaultPath() {
+		return QDir(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)).filePath("MechanicalDesign/cycles");
+	}
+
+	QString SimulationCache::entryPath(unsigned long long hash) const {
+		return QDir(path).filePath(QString("%1-v%2.cycle").arg(hash, 16, 16, QChar('0')).arg(SOLVER_VERSION));
+	}
+
+	/**
+	 * Read the entry of the design of the given hash. The file is memory-mapped, and
+	 * its arrays are copied once the header and the sizes have been verified.
+	 */
+	bool SimulationCache::load(unsigned long long hash, CycleResult& result) const {
+		QFile file(entryPath(hash));
+		if (!file.open(QFile::ReadOnly)) return false;
+
+		qint64 size = file.size();
+		if (size < sizeof(CacheHeader)) return false;
+		const unsigned char* data = file.map(0, size);
+		if (data == NULL) return false;
+
+		bool ok = readEntry(data, size, hash, result);
+		file.unmap(const_cast<unsigned char*>(data));
+
+		return ok;
+	}
+
+	/**
+	 * Write the entry of the design of the given hash. The file is written under a
+	 * temporary name and then renamed, so that the readers, including other threads
+	 * or processes writing the same entry, never see a partial one.
+	 */
+	bool SimulationCache::save(unsigned long long hash, const CycleResult& result) const {
+		if (!QDir().mkpath(path)) return false;
+
+		CacheHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, CACHE_MAGIC, 4);
+		header.version = CACHE_VERSION;
+		header.solver_version = SOLVER_VERSION;
+		header.payload_size = sizeof(PhaseClock) * result.frames.phases.size() + sizeof(glm::vec2) * result.end_effectors.size()
+			+ sizeof(float) * (result.frames.x.size() + result.frames.y.size()) + result.solved.size() + result.frames.recorded.size();
+		header.hash = hash;
+		header.num_steps = result.num_steps;
+		header.num_assemblies = result.num_assemblies;
+		header.failure_code = result.failure.code;
+		header.failure_point = result.failure.point;
+		header.failure_link1 = result.failure.link1;
+		header.failure_link2 = result.failure.link2;
+		header.failure_assembly = result.failure.assembly;
+		header.failure_phase = result.failure.phase;
+		header.failure_step = result.failure_step;
+		header.num_failed_steps = result.num_failed_steps;
+		header.num_frames = result.frames.num_frames;
+		header.num_points = result.frames.num_points;
+		header.num_phases = result.frames.num_phases;
+
+		QSaveFile file(entryPath(hash));
+		if (!file.open(QFile::WriteOnly)) return false;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		writeArray(file, result.frames.phases);
+		writeArray(file, result.end_effectors);
+		writeArray(file, result.frames.x);
+		writeArray(file, result.frames.y);
+		writeArray(file, result.solved);
+		writeArray(file, result.frames.recorded);
+		if (!file.commit()) return false;
+
+		evict();
+		return true;
+	}
+
+	/**
+	 * Remove the least recently written entries until the rest fit in the maximum
+	 * size. An entry that another process has already removed is skipped.
+	 */
+	void SimulationCache::evict() const {
+		QFileInfoList entries = QDir(path).entryInfoList(QStringList("*.cycle"), QDir::Files, QDir::Time);
+
+		// the entries are sorted from the newest
+		qint64 size = 0;
+		for (int i = 0; i < entries.size(); ++i) {
+			size += entries[i].size();
+			if (size > max_size) QFile::remove(entries[i].filePath());
+		}
+	}
+
+	/**
+	 * Get the full-cycle result of the design from the cache. Returns false if it
+	 * is not there.
+	 */
+	bool SimulationCache::find(const Kinematics& design, CycleResult& result) const {
+		return load(design.designHash(), result) && result.num_assemblies == design.assemblies.size();
+	}
+
+	/**
+	 * Get the full-cycle result of the design from the cache, or simulate it and
+	 * store it in the cache. Returns whether the result was found in the cache.
+	 */
+	bool SimulationCache::lookup(const Kinematics& design, CycleResult& result) const {
+		if (find(design, result)) return true;
+
+		simulateCycle(design, result);
+		save(design.designHash(), result);
+
+		return false;
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QString>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Kinematics.h"
+
+namespace kinematics {
+	/**
+	 * Result of simulating one full cycle of a design from its loaded state, i.e.,
+	 * until all the gears return to their initial phases (one turn of the crank if
+	 * the design is not periodic). It holds whether each step can be solved, the
+	 * end-effector positions at the solved steps, the first failure, and the frames
+	 * recorded on the way, with which stepping through the cycle again only
+	 * restores them.
+	 */
+	class CycleResult {
+	public:
+		int num_steps;
+		int num_assemblies;
+		std::vector<unsigned char> solved;
+		std::vector<glm::vec2> end_effectors;
+		SolveStatus failure;
+		int failure_step;
+		int num_failed_steps;
+		FrameCache frames;
+
+	public:
+		CycleResult() : num_steps(0), num_assemblies(0), failure_step(-1), num_failed_steps(0) {}
+
+		bool valid() const { return num_failed_steps == 0; }
+		glm::vec2 endEffector(int step, int assembly) const { return end_effectors[step * num_assemblies + assembly]; }
+		bool applyFrames(Kinematics& kinematics) const;
+	};
+
+	void simulateCycle(const Kinematics& design, CycleResult& result);
+
+	/**
+	 * Full-cycle results persisted in a local directory, one file per design keyed
+	 * by the content hash of the design and the version of the solver, so that an
+	 * unchanged design costs only the hash and a memory-mapped read. A missing,
+	 * stale or broken entry is a miss, and the cycle is simulated and written again.
+	 * The least recently written entries are removed when the cache grows too large.
+	 */
+	class SimulationCache {
+	public:
+		QString path;
+		qint64 max_size;
+
+	public:
+		SimulationCache(const QString& path = defaultPath());
+
+		static QString defaultPath();
+		QString entryPath(unsigned long long hash) const;
+		bool load(unsigned long long hash, CycleResult& result) const;
+		bool save(unsigned long long hash, const CycleResult& result) const;
+		void evict() const;
+		bool find(const Kinematics& design, CycleResult& result) const;
+		bool lookup(const Kinematics& design, CycleResult& result) const;
+	};
+}
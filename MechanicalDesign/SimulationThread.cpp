@@ -0,0 +1,60 @@
+#include "SimulationThread.h"
+#include <QElapsedTimer>
+
+namespace {
+	// steps that are not caught up within this many intervals are dropped
+	const int MAX_CATCH_UP_STEPS = 10;
+}
+
+/**
+ * The mechanism is copied, so that the given one can keep being used by the GUI
+ * thread. The initial state is published right away.
+ */
+SimulationThread::SimulationThread(const kinematics::Kinematics& kinematics, int interval) : interval(interval), stopping(false), failed(false) {
+	kinematics.copyTo(this->kinematics);
+
+	this->kinematics.takeSnapshot(snapshots.writeBuffer());
+	snapshots.publish();
+}
+
+SimulationThread::~SimulationThread() {
+	stop();
+}
+
+/**
+ * Stop stepping and wait for the thread to finish.
+ */
+void SimulationThread::stop() {
+	stopping = true;
+	wait();
+}
+
+void SimulationThread::run() {
+	QElapsedTimer timer;
+	timer.start();
+	qint64 next_step = interval;
+
+	while (!stopping) {
+		qint64 now = timer.elapsed();
+		if (now < next_step) {
+			msleep(next_step - now);
+			continue;
+		}
+
+		// skip the steps that are too far behind instead of trying to catch up with them
+		if (now - next_step > interval * MAX_CATCH_UP_STEPS) {
+			next_step = now;
+		}
+
+		kinematics::SolveStatus status = kinematics.stepForward();
+		if (!status.ok()) {
+			error = status.message();
+			failed = true;
+			break;
+		}
+		next_step += interval;
+
+		kinematics.takeSnapshot(snapshots.writeBuffer());
+		snapshots.publish();
+	}
+}
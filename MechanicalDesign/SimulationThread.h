@@ -0,0 +1,31 @@
+#pragma once
+
+#include <QThread>
+#include <QString>
+#include <atomic>
+#include "Kinematics.h"
+#include "TripleBuffer.h"
+
+/**
+ * Worker thread that steps its own copy of the mechanism at a fixed rate, and
+ * publishes a snapshot of the state after every step. The GUI thread picks up the
+ * latest snapshot when it paints, so a slow paint does not slow down the mechanism.
+ */
+class SimulationThread : public QThread {
+public:
+	kinematics::Kinematics kinematics;
+	int interval;
+	TripleBuffer<kinematics::KinematicsSnapshot> snapshots;
+	std::atomic<bool> stopping;
+	std::atomic<bool> failed;
+	QString error;
+
+public:
+	SimulationThread(const kinematics::Kinematics& kinematics, int interval);
+	~SimulationThread();
+
+	void stop();
+
+protected:
+	void run();
+};
@@ -0,0 +1,55 @@
+#include "TrajectoryPreview.h"
+#include <algorithm>
+
+namespace {
+	// the cancellation is checked after each chunk of this many samples
+	const int CHUNK_SIZE = 256;
+
+	// the trajectories of non-periodic mechanisms are previewed for one turn of the crank
+	const float PI = 3.141592653f;
+}
+
+TrajectoryPreview::TrajectoryPreview(const kinematics::Kinematics& kinematics) : canceled(false) {
+	for (int i = 0; i < kinematics.assemblies.size(); ++i) {
+		assemblies.push_back(*kinematics.assemblies[i]);
+	}
+
+	time_step = kinematics.time_step;
+	float period = kinematics.cyclePeriod();
+	if (period == 0) period = PI * 2;
+	num_samples = ceilf(period / time_step) + 1;
+}
+
+TrajectoryPreview::~TrajectoryPreview() {
+	cancel();
+}
+
+/**
+ * Stop the computation and wait for the thread to finish.
+ */
+void TrajectoryPreview::cancel() {
+	canceled = true;
+	wait();
+}
+
+/**
+ * Sample the end effectors in chunks, advancing the copied assemblies after each
+ * chunk. A trajectory ends before the first chunk in which its assembly cannot
+ * be assembled.
+ */
+void TrajectoryPreview::run() {
+	trajectories.resize(assemblies.size(), RingBuffer<glm::vec2>(num_samples));
+
+	std::vector<glm::vec2> positions;
+	for (int i = 0; i < assemblies.size() && !canceled; ++i) {
+		for (int j = 0; j < num_samples && !canceled; j += CHUNK_SIZE) {
+			int n = std::min(CHUNK_SIZE, num_samples - j);
+			if (!assemblies[i].sampleEndEffectorPositions(time_step, n, positions)) break;
+
+			for (int k = 0; k < n; ++k) {
+				trajectories[i].push_back(positions[k]);
+			}
+			assemblies[i].forward(time_step * n);
+		}
+	}
+}
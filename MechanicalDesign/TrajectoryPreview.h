@@ -0,0 +1,28 @@
+#pragma once
+
+#include <QThread>
+#include <atomic>
+#include "Kinematics.h"
+
+/**
+ * Background computation of the end-effector trajectories over one full cycle,
+ * to preview the effect of a phase change without running the mechanism.
+ * The computation works on copies of the assemblies and can be canceled.
+ */
+class TrajectoryPreview : public QThread {
+public:
+	std::vector<kinematics::MechanicalAssembly> assemblies;
+	float time_step;
+	int num_samples;
+	std::vector<RingBuffer<glm::vec2>> trajectories;
+	std::atomic<bool> canceled;
+
+public:
+	TrajectoryPreview(const kinematics::Kinematics& kinematics);
+	~TrajectoryPreview();
+
+	void cancel();
+
+protected:
+	void run();
+};
@@ -0,0 +1,110 @@
+#include "CycleRenderer.h"
+#include "Kinematics.h"
+#include "SimulationCache.h"
+#include "ThreadPool.h"
+#include <QFileInfo>
+#include <QImage>
+#include <QPainter>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+
+namespace {
+	const float PI = 3.141592653f;
+}
+
+/**
+ * Simulate one full cycle of a design, and render each frame into a numbered PNG
+ * (frame_0000.png, ...) in a subdirectory of the output directory named after the
+ * design. The frames are simulated in order first, and then rendered in parallel,
+ * each thread drawing a contiguous range of frames with its own copy of the
+ * mechanism, which does not share the gear outlines with the others. The images
+ * are drawn at supersampling times the size and scaled down. With a cache, the
+ * frames are restored from it instead of solved.
+ */
+bool renderCycle(const QString& filename, const QDir& output_dir, const RenderOptions& options, const kinematics::SimulationCache* cache) {
+	kinematics::Kinematics kinematics;
+	std::vector<kinematics::KinematicsSnapshot> frames;
+	try {
+		kinematics.load(filename);
+
+		if (cache != NULL) {
+			kinematics::CycleResult cycle;
+			cache->lookup(kinematics, cycle);
+			cycle.applyFrames(kinematics);
+		}
+
+		// the time step of a periodic design divides the period into exactly its cached
+		// frames, which dividing the period by the rounded time step may exceed by one
+		int num_frames = kinematics.frame_cache.num_frames;
+		if (num_frames == 0) {
+			float period = kinematics.cyclePeriod();
+			if (period == 0) period = PI * 2;
+			num_frames = ceilf(period / kinematics.time_step);
+		}
+
+		frames.resize(num_frames);
+		for (int i = 0; i < num_frames; ++i) {
+			kinematics::SolveStatus status = i > 0 ? kinematics.stepForward() : kinematics.forwardKinematics();
+			if (!status.ok()) {
+				std::cerr << filename.toUtf8().constData() << ": frame " << i << ": " << status.message().toUtf8().constData() << std::endl;
+				return false;
+			}
+			kinematics.takeSnapshot(frames[i]);
+		}
+	}
+	catch (const char* ex) {
+		std::cerr << filename.toUtf8().constData() << ": " << ex << std::endl;
+		return false;
+	}
+	catch (const QString& ex) {
+		std::cerr << filename.toUtf8().constData() << ": " << ex.toUtf8().constData() << std::endl;
+		return false;
+	}
+
+	QString dir_name = QFileInfo(filename).completeBaseName();
+	if (!output_dir.mkpath(dir_name)) {
+		std::cerr << filename.toUtf8().constData() << ": cannot create the directory for the frames." << std::endl;
+		return false;
+	}
+	QDir frame_dir(output_dir.filePath(dir_name));
+
+	int supersampling = std::max(1, options.supersampling);
+	std::atomic<int> num_failed(0);
+	{
+		ThreadPool pool(options.num_threads);
+		int num_tasks = std::min(pool.size(), (int)frames.size());
+		for (int t = 0; t < num_tasks; ++t) {
+			int first = frames.size() * t / num_tasks;
+			int last = frames.size() * (t + 1) / num_tasks;
+			pool.submit([&, first, last]() {
+				kinematics::Kinematics copy;
+				kinematics.copyTo(copy);
+
+				QImage image(options.width * supersampling, options.height * supersampling, QImage::Format_ARGB32_Premultiplied);
+				for (int i = first; i < last; ++i) {
+					copy.applySnapshot(frames[i]);
+
+					image.fill(Qt::white);
+					QPainter painter(&image);
+					painter.setRenderHint(QPainter::Antialiasing);
+					painter.scale(supersampling, supersampling);
+					copy.draw(painter);
+					painter.end();
+
+					QImage frame = supersampling > 1 ? image.scaled(options.width, options.height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation) : image;
+					if (!frame.save(frame_dir.filePath(QString("frame_%1.png").arg(i, 4, 10, QChar('0'))))) num_failed++;
+				}
+			});
+		}
+		pool.wait();
+	}
+
+	if (num_failed > 0) {
+		std::cerr << filename.toUtf8().constData() << ": " << num_failed << " frames cannot be written." << std::endl;
+		return false;
+	}
+
+	std::cout << filename.toUtf8().constData() << ": " << frames.size() << " frames" << std::endl;
+	return true;
+}
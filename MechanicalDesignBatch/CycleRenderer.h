@@ -0,0 +1,24 @@
+#pragma once
+
+#include <QString>
+#include <QDir>
+
+namespace kinematics {
+	class SimulationCache;
+}
+
+/**
+ * Options of rendering one cycle of a design to images.
+ */
+class RenderOptions {
+public:
+	int width;
+	int height;
+	int supersampling;
+	int num_threads;
+
+public:
+	RenderOptions() : width(800), height(800), supersampling(2), num_threads(0) {}
+};
+
+bool renderCycle(const QString& filename, const QDir& output_dir, const RenderOptions& options, const kinematics::SimulationCache* cache = NULL);
@@ -0,0 +1,217 @@
+#include "DesignEvaluator.h"
+#include "Kinematics.h"
+#include "SimulationCache.h"
+#include "FourBarKinematics.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QXmlStreamReader>
+
+namespace {
+	const float PI = 3.141592653f;
+
+	// the crank speed of FourBarLinkage
+	const double FOUR_BAR_TIME_STEP = 0.02;
+}
+
+void TrajectoryStats::add(int index, const glm::vec2& pos) {
+	if (empty) {
+		bbox_min = pos;
+		bbox_max = pos;
+		empty = false;
+	}
+	else {
+		bbox_min = glm::min(bbox_min, pos);
+		bbox_max = glm::max(bbox_max, pos);
+	}
+
+	if (index >= prev.size()) {
+		prev.resize(index + 1, pos);
+	}
+	path_length += glm::length(pos - prev[index]);
+	prev[index] = pos;
+}
+
+/**
+ * Evaluate a design of either MechanicalDesign or FourBarLinkage, telling them apart
+ * by the root element's children. Binary designs are always MechanicalDesign ones.
+ * The cycles of MechanicalDesign designs are taken from the cache if one is given.
+ */
+EvaluationResult evaluateDesign(const QString& filename, const kinematics::SimulationCache* cache) {
+	if (QFileInfo(filename).suffix().toLower() == "mdb") {
+		return evaluateMechanicalDesign(filename, cache);
+	}
+
+	QFile file(filename);
+	if (!file.open(QFile::ReadOnly | QFile::Text)) {
+		EvaluationResult result;
+		result.filename = filename;
+		result.error = "File cannot open.";
+		return result;
+	}
+
+	// look at the first child of the root only
+	QXmlStreamReader xml(&file);
+	bool four_bar = false;
+	if (xml.readNextStartElement() && xml.readNextStartElement()) {
+		four_bar = xml.name() == "ground_points" || xml.name() == "lengths";
+	}
+	file.close();
+
+	if (four_bar) {
+		return evaluateFourBarLinkage(filename);
+	}
+	else {
+		return evaluateMechanicalDesign(filename, cache);
+	}
+}
+
+/**
+ * Simulate one full cycle of a MechanicalDesign design, i.e., until all the gears
+ * return to their initial phases (one turn of the crank if the gear speeds are not
+ * rational multiples of each other), or take it from the cache if the design has
+ * not changed. The simulation continues past the steps that cannot be solved,
+ * which are counted, and the first of them is reported.
+ */
+EvaluationResult evaluateMechanicalDesign(const QString& filename, const kinematics::SimulationCache* cache) {
+	EvaluationResult result;
+	result.filename = filename;
+	result.type = "mechanism";
+
+	kinematics::Kinematics kinematics;
+	try {
+		kinematics.load(filename);
+	}
+	catch (const char* ex) {
+		result.error = ex;
+		result.failure_step = 0;
+		return result;
+	}
+	catch (const QString& ex) {
+		result.error = ex;
+		result.failure_step = 0;
+		return result;
+	}
+
+	kinematics::CycleResult cycle;
+	if (cache != NULL) {
+		result.cached = cache->lookup(kinematics, cycle);
+	}
+	else {
+		kinematics::simulateCycle(kinematics, cycle);
+	}
+
+	result.num_steps = cycle.num_steps;
+	result.num_failed_steps = cycle.num_failed_steps;
+	if (!cycle.valid()) {
+		result.error = cycle.failure.message();
+		result.failure_step = cycle.failure_step;
+		result.failure_point = cycle.failure.point;
+		result.failure_phase = cycle.failure.phase;
+	}
+	result.valid = cycle.valid();
+
+	TrajectoryStats stats;
+	for (int step = 0; step <= cycle.num_steps; ++step) {
+		if (!cycle.solved[step]) continue;
+
+		for (int i = 0; i < cycle.num_assemblies; ++i) {
+			stats.add(i, cycle.endEffector(step, i));
+		}
+	}
+
+	result.bbox_min = stats.bbox_min;
+	result.bbox_max = stats.bbox_max;
+	result.path_length = stats.path_length;
+
+	return result;
+}
+
+/**
+ * Simulate one turn of the crank of a FourBarLinkage design. Same as the
+ * FourBarLinkage app, the two free joints are chosen to be closest to the position
+ * extrapolated from the previous two frames, and the trajectory of the last point is
+ * measured.
+ */
+EvaluationResult evaluateFourBarLinkage(const QString& filename) {
+	EvaluationResult result;
+	result.filename = filename;
+	result.type = "four-bar";
+
+	QFile file(filename);
+	if (!file.open(QFile::ReadOnly | QFile::Text)) {
+		result.error = "File cannot open.";
+		return result;
+	}
+
+	std::vector<glm::dvec2> ground_points;
+	std::vector<double> lengths;
+	double theta = 0;
+
+	QXmlStreamReader xml(&file);
+	if (!xml.readNextStartElement() || xml.name() != "design") {
+		if (!xml.hasError()) xml.raiseError("Invalid file format.");
+	}
+	while (!xml.hasError() && xml.readNextStartElement()) {
+		if (xml.name() == "ground_points") {
+			theta = xml.attributes().value("initial_phase").toDouble();
+			while (xml.readNextStartElement()) {
+				if (xml.name() == "ground_point") {
+					ground_points.push_back(glm::dvec2(xml.attributes().value("x").toDouble(), xml.attributes().value("y").toDouble()));
+				}
+				xml.skipCurrentElement();
+			}
+		}
+		else if (xml.name() == "lengths") {
+			while (xml.readNextStartElement()) {
+				if (xml.name() == "length") {
+					lengths.push_back(xml.attributes().value("value").toDouble());
+				}
+				xml.skipCurrentElement();
+			}
+		}
+		else {
+			xml.skipCurrentElement();
+		}
+	}
+	while (!xml.atEnd()) xml.readNext();
+
+	if (xml.hasError()) {
+		result.error = QString("line %1, column %2: %3").arg(xml.lineNumber()).arg(xml.columnNumber()).arg(xml.errorString());
+		return result;
+	}
+
+	if (ground_points.size() < 2 || lengths.size() < 5) {
+		result.error = "Invalid file format.";
+		return result;
+	}
+
+	result.num_steps = ceil(PI * 2 / FOUR_BAR_TIME_STEP);
+
+	TrajectoryStats stats;
+	std::vector<glm::dvec2> points(5), prev_points, flows;
+	for (int step = 0; step <= result.num_steps; ++step) {
+		double t = theta + step * FOUR_BAR_TIME_STEP;
+		if (!fourbar::forwardKinematics(ground_points[0], ground_points[1], lengths, t, prev_points, flows, points)) {
+			result.error = "No intersection";
+			result.failure_step = step;
+			result.failure_phase = fmod(step * FOUR_BAR_TIME_STEP, PI * 2);
+			result.num_failed_steps = 1;
+			break;
+		}
+
+		if (!prev_points.empty()) {
+			flows.resize(5);
+			for (int i = 0; i < 5; ++i) flows[i] = points[i] - prev_points[i];
+		}
+		prev_points = points;
+
+		stats.add(0, glm::vec2(points[4]));
+	}
+	result.valid = result.failure_step < 0;
+
+	result.bbox_min = stats.bbox_min;
+	result.bbox_max = stats.bbox_max;
+	result.path_length = stats.path_length;
+
+	return result;
+}
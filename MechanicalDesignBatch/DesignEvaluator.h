@@ -0,0 +1,53 @@
+#pragma once
+
+#include <QString>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace kinematics {
+	class SimulationCache;
+}
+
+/**
+ * Result of simulating one full cycle of a design.
+ */
+class EvaluationResult {
+public:
+	QString filename;
+	QString type;
+	bool valid;
+	QString error;
+	int num_steps;
+	int failure_step;
+	int failure_point;
+	float failure_phase;
+	int num_failed_steps;
+	glm::vec2 bbox_min;
+	glm::vec2 bbox_max;
+	float path_length;
+	bool cached;
+
+public:
+	EvaluationResult() : valid(false), num_steps(0), failure_step(-1), failure_point(-1), failure_phase(0), num_failed_steps(0), bbox_min(0, 0), bbox_max(0, 0), path_length(0), cached(false) {}
+};
+
+/**
+ * Trajectory statistics of the end-effectors.
+ */
+class TrajectoryStats {
+public:
+	glm::vec2 bbox_min;
+	glm::vec2 bbox_max;
+	float path_length;
+	std::vector<glm::vec2> prev;
+	bool empty;
+
+public:
+	TrajectoryStats() : bbox_min(0, 0), bbox_max(0, 0), path_length(0), empty(true) {}
+
+	void add(int index, const glm::vec2& pos);
+};
+
+EvaluationResult evaluateDesign(const QString& filename, const kinematics::SimulationCache* cache = NULL);
+EvaluationResult evaluateMechanicalDesign(const QString& filename, const kinematics::SimulationCache* cache = NULL);
+EvaluationResult evaluateFourBarLinkage(const QString& filename);
@@ -0,0 +1,295 @@
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QFileInfo>
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+#include <iostream>
+#include <cstdio>
+#include "Kinematics.h"
+#include "SimulationCache.h"
+#include "DesignEvaluator.h"
+#include "ThreadPool.h"
+#include "CycleRenderer.h"
+
+/**
+ * Simulate a design for the given number of steps without any display, and write
+ * the trajectories of the end-effectors (and optionally of all the points) as csv files.
+ * The steps that cannot be solved are reported and left out of the files, and the
+ * simulation continues. With a cache, the frames of the cycle are restored from
+ * it instead of solved.
+ */
+bool simulate(const QString& filename, int num_steps, const QDir& output_dir, bool write_points, const kinematics::SimulationCache* cache) {
+	kinematics::Kinematics kinematics;
+	kinematics::SolveStatus status;
+	try {
+		kinematics.load(filename);
+		status = kinematics.forwardKinematics();
+	}
+	catch (const char* ex) {
+		std::cerr << filename.toUtf8().constData() << ": " << ex << std::endl;
+		return false;
+	}
+	catch (const QString& ex) {
+		std::cerr << filename.toUtf8().constData() << ": " << ex.toUtf8().constData() << std::endl;
+		return false;
+	}
+
+	if (!status.ok()) {
+		std::cerr << filename.toUtf8().constData() << ": " << status.message().toUtf8().constData() << std::endl;
+		return false;
+	}
+
+	if (cache != NULL) {
+		kinematics::CycleResult cycle;
+		cache->lookup(kinematics, cycle);
+		cycle.applyFrames(kinematics);
+	}
+
+	QString basename = QFileInfo(filename).completeBaseName();
+
+	QFile end_effector_file(output_dir.filePath(basename + "_end_effectors.csv"));
+	if (!end_effector_file.open(QFile::WriteOnly | QFile::Text)) {
+		std::cerr << "Cannot write " << end_effector_file.fileName().toUtf8().constData() << std::endl;
+		return false;
+	}
+	QTextStream end_effector_out(&end_effector_file);
+	end_effector_out << "step";
+	for (int i = 0; i < kinematics.assemblies.size(); ++i) {
+		end_effector_out << ",ee" << i << "_x,ee" << i << "_y";
+	}
+	end_effector_out << "\n";
+
+	QFile point_file;
+	QTextStream point_out;
+	if (write_points) {
+		point_file.setFileName(output_dir.filePath(basename + "_points.csv"));
+		if (!point_file.open(QFile::WriteOnly | QFile::Text)) {
+			std::cerr << "Cannot write " << point_file.fileName().toUtf8().constData() << std::endl;
+			return false;
+		}
+		point_out.setDevice(&point_file);
+		point_out << "step";
+		for (int i = 0; i < kinematics.points.size(); ++i) {
+			point_out << ",p" << kinematics.points.ids[i] << "_x,p" << kinematics.points.ids[i] << "_y";
+		}
+		point_out << "\n";
+	}
+
+	int num_failed = 0;
+	for (int step = 0; step <= num_steps; ++step) {
+		if (step > 0) {
+			status = kinematics.stepForward();
+			if (!status.ok()) {
+				std::cerr << filename.toUtf8().constData() << ": step " << step << ": " << status.message().toUtf8().constData() << std::endl;
+				num_failed++;
+				continue;
+			}
+		}
+
+		end_effector_out << step;
+		for (int i = 0; i < kinematics.assemblies.size(); ++i) {
+			glm::vec2 pos = kinematics.points.pos(kinematics.assemblies[i]->end_effector);
+			end_effector_out << "," << pos.x << "," << pos.y;
+		}
+		end_effector_out << "\n";
+
+		if (write_points) {
+			point_out << step;
+			for (int i = 0; i < kinematics.points.size(); ++i) {
+				point_out << "," << kinematics.points.x[i] << "," << kinematics.points.y[i];
+			}
+			point_out << "\n";
+		}
+	}
+
+	std::cout << filename.toUtf8().constData() << ": " << num_steps << " steps";
+	if (num_failed > 0) std::cout << ", " << num_failed << " failed";
+	std::cout << std::endl;
+	return num_failed == 0;
+}
+
+/**
+ * Evaluate one full cycle of each design on a thread pool, and print a summary table.
+ */
+bool summarize(const QStringList& filenames, int num_threads, const kinematics::SimulationCache* cache) {
+	std::vector<EvaluationResult> results(filenames.size());
+	{
+		ThreadPool pool(num_threads);
+		for (int i = 0; i < filenames.size(); ++i) {
+			EvaluationResult* result = &results[i];
+			QString filename = filenames[i];
+			pool.submit([result, filename, cache]() {
+				*result = evaluateDesign(filename, cache);
+			});
+		}
+		pool.wait();
+	}
+
+	int num_invalid = 0;
+	int num_cached = 0;
+	printf("%-40s %-10s %-8s %6s %-44s %-36s %10s\n", "design", "type", "status", "steps", "failure", "bounding box", "path");
+	for (int i = 0; i < results.size(); ++i) {
+		const EvaluationResult& r = results[i];
+		if (r.cached) num_cached++;
+		QString failure = "-";
+		if (!r.valid) {
+			num_invalid++;
+			failure = QString("step %1").arg(r.failure_step);
+			if (r.failure_point >= 0) failure += QString(", point %1").arg(r.failure_point);
+			failure += QString(", phase %1").arg(r.failure_phase, 0, 'f', 3);
+			if (r.num_failed_steps > 1) failure += QString(" (%1 steps)").arg(r.num_failed_steps);
+		}
+		QString bbox = QString("(%1, %2)-(%3, %4)").arg(r.bbox_min.x, 0, 'f', 1).arg(r.bbox_min.y, 0, 'f', 1).arg(r.bbox_max.x, 0, 'f', 1).arg(r.bbox_max.y, 0, 'f', 1);
+		printf("%-40s %-10s %-8s %6d %-44s %-36s %10.1f\n", QFileInfo(r.filename).fileName().toUtf8().constData(), r.type.toUtf8().constData(), r.valid ? "valid" : "invalid", r.num_steps, failure.toUtf8().constData(), bbox.toUtf8().constData(), r.path_length);
+		if (!r.valid && !r.error.isEmpty()) {
+			std::cerr << r.filename.toUtf8().constData() << ": " << r.error.toUtf8().constData() << std::endl;
+		}
+	}
+	printf("%d designs, %d invalid, %d from the cache\n", (int)results.size(), num_invalid, num_cached);
+
+	return num_invalid == 0;
+}
+
+/**
+ * Convert a design between the XML format and the binary format.
+ */
+bool convert(const QString& filename, const QDir& output_dir) {
+	QFileInfo info(filename);
+	QString suffix = info.suffix().toLower() == "mdb" ? "xml" : "mdb";
+	QString output_filename = output_dir.filePath(info.completeBaseName() + "." + suffix);
+
+	kinematics::Kinematics kinematics;
+	try {
+		kinematics.load(filename);
+		kinematics.save(output_filename);
+	}
+	catch (const char* ex) {
+		std::cerr << filename.toUtf8().constData() << ": " << ex << std::endl;
+		return false;
+	}
+	catch (const QString& ex) {
+		std::cerr << filename.toUtf8().constData() << ": " << ex.toUtf8().constData() << std::endl;
+		return false;
+	}
+
+	std::cout << filename.toUtf8().constData() << " -> " << output_filename.toUtf8().constData() << std::endl;
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	// rendering needs a QPA platform, and this has to run without a display
+	if (qgetenv("QT_QPA_PLATFORM").isEmpty()) qputenv("QT_QPA_PLATFORM", "offscreen");
+
+	QGuiApplication a(argc, argv);
+	QCoreApplication::setApplicationName("MechanicalDesignBatch");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Simulate mechanical designs without a display.");
+	parser.addHelpOption();
+	QCommandLineOption steps_option(QStringList() << "n" << "steps", "Number of simulation steps (default 1000).", "steps", "1000");
+	parser.addOption(steps_option);
+	QCommandLineOption output_option(QStringList() << "o" << "output", "Directory for the trajectory files (default: current directory).", "dir", ".");
+	parser.addOption(output_option);
+	QCommandLineOption points_option(QStringList() << "p" << "points", "Also write the trajectories of all the points.");
+	parser.addOption(points_option);
+	QCommandLineOption summary_option(QStringList() << "s" << "summary", "Simulate one full cycle of each design in parallel and print a summary table instead of writing the trajectories. Implied when a directory is given.");
+	parser.addOption(summary_option);
+	QCommandLineOption threads_option(QStringList() << "j" << "threads", "Number of threads for the summary and the rendering (default: number of cores).", "threads", "0");
+	parser.addOption(threads_option);
+	QCommandLineOption convert_option(QStringList() << "c" << "convert", "Convert each design between XML (*.xml) and binary (*.mdb) into the output directory instead of simulating it.");
+	parser.addOption(convert_option);
+	QCommandLineOption render_option(QStringList() << "r" << "render", "Render one full cycle of each design into numbered PNG images in a subdirectory of the output directory instead of simulating it.");
+	parser.addOption(render_option);
+	QCommandLineOption size_option("size", "Size of the rendered images (default 800x800).", "WxH", "800x800");
+	parser.addOption(size_option);
+	QCommandLineOption supersampling_option("supersampling", "Supersampling factor of the rendered images (default 2).", "factor", "2");
+	parser.addOption(supersampling_option);
+	QCommandLineOption cache_option("cache", "Directory of the cached full-cycle results (default: the user cache directory).", "dir", kinematics::SimulationCache::defaultPath());
+	parser.addOption(cache_option);
+	QCommandLineOption no_cache_option("no-cache", "Simulate every design without reading or writing the cache.");
+	parser.addOption(no_cache_option);
+	parser.addPositionalArgument("designs", "Design files (*.xml, *.mdb) or directories of design files to simulate.", "designs...");
+	parser.process(a);
+
+	QStringList args = parser.positionalArguments();
+	if (args.isEmpty()) parser.showHelp(1);
+
+	QStringList filenames;
+	bool summary = parser.isSet(summary_option);
+	for (int i = 0; i < args.size(); ++i) {
+		QFileInfo info(args[i]);
+		if (info.isDir()) {
+			QFileInfoList entries = QDir(args[i]).entryInfoList(QStringList() << "*.xml" << "*.mdb", QDir::Files, QDir::Name);
+			for (int j = 0; j < entries.size(); ++j) {
+				filenames.push_back(entries[j].filePath());
+			}
+			summary = true;
+		}
+		else {
+			filenames.push_back(args[i]);
+		}
+	}
+
+	QDir output_dir(parser.value(output_option));
+	if (!output_dir.exists() && !output_dir.mkpath(".")) {
+		std::cerr << "Cannot create the output directory." << std::endl;
+		return 1;
+	}
+
+	kinematics::SimulationCache cache(parser.value(cache_option));
+	const kinematics::SimulationCache* cache_ptr = parser.isSet(no_cache_option) ? NULL : &cache;
+
+	if (parser.isSet(convert_option)) {
+		int num_failed = 0;
+		for (int i = 0; i < filenames.size(); ++i) {
+			if (!convert(filenames[i], output_dir)) num_failed++;
+		}
+		return num_failed > 0 ? 1 : 0;
+	}
+
+	if (parser.isSet(render_option)) {
+		RenderOptions options;
+		QStringList size = parser.value(size_option).split("x");
+		bool ok_width = false, ok_height = false;
+		if (size.size() == 2) {
+			options.width = size[0].toInt(&ok_width);
+			options.height = size[1].toInt(&ok_height);
+		}
+		if (!ok_width || !ok_height || options.width <= 0 || options.height <= 0) {
+			std::cerr << "Invalid image size." << std::endl;
+			return 1;
+		}
+		options.supersampling = parser.value(supersampling_option).toInt();
+		if (options.supersampling <= 0) {
+			std::cerr << "Invalid supersampling factor." << std::endl;
+			return 1;
+		}
+		options.num_threads = parser.value(threads_option).toInt();
+
+		int num_failed = 0;
+		for (int i = 0; i < filenames.size(); ++i) {
+			if (!renderCycle(filenames[i], output_dir, options, cache_ptr)) num_failed++;
+		}
+		return num_failed > 0 ? 1 : 0;
+	}
+
+	if (summary) {
+		int num_threads = parser.value(threads_option).toInt();
+		return summarize(filenames, num_threads, cache_ptr) ? 0 : 1;
+	}
+
+	bool ok = false;
+	int num_steps = parser.value(steps_option).toInt(&ok);
+	if (!ok || num_steps < 0) {
+		std::cerr << "Invalid number of steps." << std::endl;
+		return 1;
+	}
+
+	int num_failed = 0;
+	for (int i = 0; i < filenames.size(); ++i) {
+		if (!simulate(filenames[i], num_steps, output_dir, parser.isSet(points_option), cache_ptr)) num_failed++;
+	}
+
+	return num_failed > 0 ? 1 : 0;
+}
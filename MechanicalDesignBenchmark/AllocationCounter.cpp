@@ -0,0 +1,53 @@
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+	std::atomic<long long> num_allocations(0);
+
+	void* countedAlloc(std::size_t size) {
+		num_allocations++;
+		return std::malloc(size > 0 ? size : 1);
+	}
+}
+
+long long allocationCount() {
+	return num_allocations.load();
+}
+
+void* operator new(std::size_t size) {
+	void* ptr = countedAlloc(size);
+	if (ptr == NULL) throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new[](std::size_t size) {
+	void* ptr = countedAlloc(size);
+	if (ptr == NULL) throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) throw() {
+	return countedAlloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) throw() {
+	return countedAlloc(size);
+}
+
+void operator delete(void* ptr) throw() {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) throw() {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) throw() {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) throw() {
+	std::free(ptr);
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+/**
+ * Number of heap allocations made through the global operator new since the start
+ * of the program. The benchmark executable replaces operator new/delete to count them.
+ */
+long long allocationCount();
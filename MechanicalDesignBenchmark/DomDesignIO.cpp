@@ -0,0 +1,274 @@
+#include "DomDesignIO.h"
+#include <QFile>
+#include <QDomDocument>
+#include <QTextStream>
+#include <QDate>
+
+using namespace kinematics;
+
+/**
+ * Load a design by building a QDomDocument first, which is what Kinematics::load did
+ * before it switched to QXmlStreamReader.
+ */
+void loadDesignWithDom(Kinematics& kinematics, const QString& filename) {
+	PointStore& points = kinematics.points;
+	std::vector<boost::shared_ptr<MechanicalAssembly>>& assemblies = kinematics.assemblies;
+	std::vector<Link>& links = kinematics.links;
+	std::vector<Part>& bodies = kinematics.bodies;
+	std::vector<RingBuffer<glm::vec2>>& trace_end_effector = kinematics.trace_end_effector;
+
+	QFile file(filename);
+	if (!file.open(QFile::ReadOnly | QFile::Text)) throw "Fild cannot open.";
+
+	QDomDocument doc;
+	doc.setContent(&file);
+
+	QDomElement root = doc.documentElement();
+	if (root.tagName() != "design")	throw "Invalid file format.";
+
+	// clear the data
+	points.clear();
+	assemblies.clear();
+	links.clear();
+	bodies.clear();
+	trace_end_effector.clear();
+
+	QDomNode node = root.firstChild();
+	while (!node.isNull()) {
+		if (node.toElement().tagName() == "points") {
+			QDomNode point_node = node.firstChild();
+			while (!point_node.isNull()) {
+				if (point_node.toElement().tagName() == "point") {
+					// add a point
+					int id = point_node.toElement().attribute("id").toInt();
+					float x = point_node.toElement().attribute("x").toFloat();
+					float y = point_node.toElement().attribute("y").toFloat();
+					points.add(id, glm::vec2(x, y));
+				}
+
+				point_node = point_node.nextSibling();
+			}
+		}
+		else if (node.toElement().tagName() == "assemblies") {
+			QDomNode assembly_node = node.firstChild();
+			while (!assembly_node.isNull()) {
+				if (assembly_node.toElement().tagName() == "assembly") {
+					// add an assembly
+					boost::shared_ptr<MechanicalAssembly> ass = boost::shared_ptr<MechanicalAssembly>(new MechanicalAssembly());
+
+					int end_effector_id = assembly_node.toElement().attribute("end_effector").toInt();
+					ass->end_effector = points.indexOf(end_effector_id);
+					if (ass->end_effector < 0) throw "Invalid point id.";
+
+					QDomNode assembly_part_node = assembly_node.firstChild();
+					while (!assembly_part_node.isNull()) {
+						if (assembly_part_node.toElement().tagName() == "gear") {
+							float x = assembly_part_node.toElement().attribute("x").toFloat();
+							float y = assembly_part_node.toElement().attribute("y").toFloat();
+							float radius = assembly_part_node.toElement().attribute("radius").toFloat();
+							float phase = assembly_part_node.toElement().attribute("phase").toFloat();
+							float speed = assembly_part_node.toElement().attribute("speed").toFloat();
+
+							ass->gears.push_back(Gear(glm::vec2(x, y), radius, phase, speed));
+						}
+						else if (assembly_part_node.toElement().tagName() == "order") {
+							int id1 = assembly_part_node.toElement().attribute("id1").toInt();
+							int id2 = assembly_part_node.toElement().attribute("id2").toInt();
+							ass->order = std::make_pair(id1, id2);
+						}
+						else if (assembly_part_node.toElement().tagName() == "link") {
+							float length = assembly_part_node.toElement().attribute("length").toFloat();
+							ass->link_lengths.push_back(length);
+						}
+
+						assembly_part_node = assembly_part_node.nextSibling();
+					}
+
+					glm::vec2 pos;
+					if (!ass->getEndEffectorPosition(pos)) throw "No intersection";
+					points.setPos(ass->end_effector, pos);
+					assemblies.push_back(ass);
+				}
+
+				assembly_node = assembly_node.nextSibling();
+			}
+		}
+		else if (node.toElement().tagName() == "links") {
+			QDomNode link_node = node.firstChild();
+			while (!link_node.isNull()) {
+				if (link_node.toElement().tagName() == "link") {
+					// add a link
+					int order = link_node.toElement().attribute("order").toInt();
+					int start = points.indexOf(link_node.toElement().attribute("start").toInt());
+					int end = points.indexOf(link_node.toElement().attribute("end").toInt());
+					if (start < 0 || end < 0) throw "Invalid point id.";
+					if (order < 0) throw "Invalid link order.";
+					links.push_back(Link(start, end, order, glm::length(points.pos(start) - points.pos(end))));
+				}
+
+				link_node = link_node.nextSibling();
+			}
+		}
+		else if (node.toElement().tagName() == "bodies") {
+			QDomNode body_node = node.firstChild();
+			while (!body_node.isNull()) {
+				if (body_node.toElement().tagName() == "body") {
+					// add a body
+					int id1 = points.indexOf(body_node.toElement().attribute("id1").toInt());
+					int id2 = points.indexOf(body_node.toElement().attribute("id2").toInt());
+					if (id1 < 0 || id2 < 0) throw "Invalid point id.";
+					Part part(id1, id2);
+
+					// setup rotation matrix
+					glm::vec2 dir = points.pos(id2) - points.pos(id1);
+					float angle = atan2f(dir.y, dir.x);
+					glm::vec2 p1 = (points.pos(id1) + points.pos(id2)) * 0.5f;
+					glm::mat4x4 model;
+					model = glm::rotate(model, -angle, glm::vec3(0, 0, 1));						
+											
+					QDomNode point_node = body_node.firstChild();
+					while (!point_node.isNull()) {
+						if (point_node.toElement().tagName() == "point") {
+							float x = point_node.toElement().attribute("x").toFloat();
+							float y = point_node.toElement().attribute("y").toFloat();
+
+							// convert the coordinates to the local coordinate system
+							glm::vec2 rotated_p = glm::vec2(model * glm::vec4(x - p1.x, y - p1.y, 0, 1));
+							
+							part.points.push_back(rotated_p);
+						}
+
+						point_node = point_node.nextSibling();
+					}
+
+					bodies.push_back(part);
+				}
+
+				body_node = body_node.nextSibling();
+			}
+		}
+
+		node = node.nextSibling();
+	}
+
+	trace_end_effector.resize(assemblies.size(), RingBuffer<glm::vec2>(240));
+
+	points.buildAdjacency(links);
+	kinematics.compile();
+	kinematics.invalidateFrameCache();
+}
+
+/**
+ * Save a design by building a QDomDocument first, which is what Kinematics::save did
+ * before it switched to QXmlStreamWriter.
+ */
+void saveDesignWithDom(const Kinematics& kinematics, const QString& filename) {
+	const PointStore& points = kinematics.points;
+	const std::vector<boost::shared_ptr<MechanicalAssembly>>& assemblies = kinematics.assemblies;
+	const std::vector<Link>& links = kinematics.links;
+	const std::vector<Part>& bodies = kinematics.bodies;
+
+	QFile file(filename);
+	if (!file.open(QFile::WriteOnly)) throw "File cannot open.";
+
+	QDomDocument doc;
+
+	// set root node
+	QDomElement root = doc.createElement("design");
+	root.setAttribute("author", "Gen Nishida");
+	root.setAttribute("version", "1.0");
+	root.setAttribute("date", QDate::currentDate().toString("MM/dd/yyyy"));
+	doc.appendChild(root);
+
+	// write points
+	QDomElement points_node = doc.createElement("points");
+	root.appendChild(points_node);
+	for (int i = 0; i < points.size(); ++i) {
+		QDomElement point_node = doc.createElement("point");
+		point_node.setAttribute("id", points.ids[i]);
+		point_node.setAttribute("x", points.x[i]);
+		point_node.setAttribute("y", points.y[i]);
+		points_node.appendChild(point_node);
+	}
+
+	// write assemblies
+	QDomElement assemblies_node = doc.createElement("assemblies");
+	root.appendChild(assemblies_node);
+	for (int i = 0; i < assemblies.size(); ++i) {
+		QDomElement assembly_node = doc.createElement("assembly");
+		assembly_node.setAttribute("end_effector", points.ids[assemblies[i]->end_effector]);
+
+		// write gears
+		for (int j = 0; j < assemblies[i]->gears.size(); ++j) {
+			QDomElement gear_node = doc.createElement("gear");
+			gear_node.setAttribute("x", assemblies[i]->gears[j].center.x);
+			gear_node.setAttribute("y", assemblies[i]->gears[j].center.y);
+			gear_node.setAttribute("radius", assemblies[i]->gears[j].radius);
+			gear_node.setAttribute("phase", assemblies[i]->gears[j].phase);
+			gear_node.setAttribute("speed", assemblies[i]->gears[j].speed);
+			
+			assembly_node.appendChild(gear_node);
+		}
+
+		// write order
+		QDomElement order_node = doc.createElement("order");
+		order_node.setAttribute("id1", assemblies[i]->order.first);
+		order_node.setAttribute("id2", assemblies[i]->order.second);
+		assembly_node.appendChild(order_node);
+
+		// write links
+		for (int j = 0; j < assemblies[i]->link_lengths.size(); ++j) {
+			QDomElement link_node = doc.createElement("link");
+			link_node.setAttribute("length", assemblies[i]->link_lengths[j]);
+			assembly_node.appendChild(link_node);
+		}
+
+		assemblies_node.appendChild(assembly_node);
+	}
+
+	// write links
+	QDomElement links_node = doc.createElement("links");
+	root.appendChild(links_node);
+	for (int i = 0; i < points.size(); ++i) {
+		for (int j = 0; j < points.numInLinks(i); ++j) {
+			if (points.inLink(i, j) < 0) continue;
+
+			const Link& link = links[points.inLink(i, j)];
+			QDomElement link_node = doc.createElement("link");
+			link_node.setAttribute("order", j);
+			link_node.setAttribute("start", points.ids[link.start]);
+			link_node.setAttribute("end", points.ids[link.end]);
+			links_node.appendChild(link_node);
+		}
+	}
+
+	// write bodies
+	QDomElement bodies_node = doc.createElement("bodies");
+	root.appendChild(bodies_node);
+	for (int i = 0; i < bodies.size(); ++i) {
+		QDomElement body_node = doc.createElement("body");
+		body_node.setAttribute("id1", points.ids[bodies[i].pivot1]);
+		body_node.setAttribute("id2", points.ids[bodies[i].pivot2]);
+		bodies_node.appendChild(body_node);
+
+		// setup rotation matrix
+		glm::vec2 dir = points.pos(bodies[i].pivot2) - points.pos(bodies[i].pivot1);
+		float angle = atan2f(dir.y, dir.x);
+		glm::vec2 p1 = (points.pos(bodies[i].pivot1) + points.pos(bodies[i].pivot2)) * 0.5f;
+		glm::mat4x4 model;
+		model = glm::rotate(model, angle, glm::vec3(0, 0, 1));
+		
+		for (int k = 0; k < bodies[i].points.size(); ++k) {
+			// convert the coordinates to the local coordinate system
+			glm::vec2 rotated_p = glm::vec2(model * glm::vec4(bodies[i].points[k].x, bodies[i].points[k].y, 0, 1)) + p1;
+
+			QDomElement point_node = doc.createElement("point");
+			point_node.setAttribute("x", rotated_p.x);
+			point_node.setAttribute("y", rotated_p.y);
+			body_node.appendChild(point_node);
+		}
+	}
+
+	QTextStream out(&file);
+	doc.save(out, 4);
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <QString>
+#include "Kinematics.h"
+
+void loadDesignWithDom(kinematics::Kinematics& kinematics, const QString& filename);
+void saveDesignWithDom(const kinematics::Kinematics& kinematics, const QString& filename);
@@ -0,0 +1,257 @@
+#include "HotPathBenchmark.h"
+#include "AllocationCounter.h"
+#include "SyntheticDesign.h"
+#include "Geometry.h"
+#include "KinematicsSolver.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QDateTime>
+
+using namespace kinematics;
+
+namespace {
+	// the results are accumulated here so that the compiler cannot drop the measured calls
+	volatile float sink = 0;
+
+	/**
+	 * Run func repeatedly, doubling the number of iterations until the run takes at
+	 * least min_time milliseconds, and measure the time and the number of allocations
+	 * of the last run. Each call of func counts as ops_per_call operations.
+	 */
+	template<typename F>
+	void measure(BenchmarkResult& result, int ops_per_call, double min_time, F func) {
+		if (ops_per_call <= 0) {
+			result.error = "Nothing to measure.";
+			return;
+		}
+
+		try {
+			for (long long iterations = 1; ; iterations *= 2) {
+				long long allocations = allocationCount();
+				QElapsedTimer timer;
+				timer.start();
+				for (long long i = 0; i < iterations; ++i) {
+					func();
+				}
+				qint64 elapsed = timer.nsecsElapsed();
+				allocations = allocationCount() - allocations;
+
+				if (elapsed >= min_time * 1e6 || iterations >= (1LL << 40)) {
+					result.iterations = iterations;
+					result.ns_per_op = (double)elapsed / iterations / ops_per_call;
+					result.allocations_per_op = (double)allocations / iterations / ops_per_call;
+					break;
+				}
+			}
+		}
+		catch (const char* ex) {
+			result.error = ex;
+		}
+		catch (const QString& ex) {
+			result.error = ex;
+		}
+	}
+}
+
+/**
+ * Measure the hot paths of the kinematics on a synthetic design made of the given
+ * number of copies of the base design. Each hot path is measured on a fresh copy,
+ * so the state changed by one does not affect the others.
+ */
+void benchmarkHotPaths(const QString& design_name, const Kinematics& base, int copies, double min_time, std::vector<BenchmarkResult>& results) {
+	if (base.points.size() == 0) return;
+
+	Kinematics design;
+	makeSyntheticDesign(base, copies, design);
+
+	BenchmarkResult result;
+	result.design = design_name;
+	result.copies = copies;
+	result.num_points = design.points.size();
+
+	// the inputs of the dyad solves at the initial state
+	{
+		std::vector<glm::vec2> c1, c2;
+		std::vector<float> r1, r2;
+		for (int i = 0; i < design.solve_schedule.size(); ++i) {
+			const SolveStep& step = design.solve_schedule[i];
+			c1.push_back(design.points.pos(step.parent1));
+			r1.push_back(design.links[step.link1].length);
+			c2.push_back(design.points.pos(step.parent2));
+			r2.push_back(design.links[step.link2].length);
+		}
+
+		BenchmarkResult r = result;
+		r.name = "circleCircleIntersection";
+		measure(r, c1.size(), min_time, [&]() {
+			glm::vec2 pos;
+			for (int i = 0; i < c1.size(); ++i) {
+				if (geometry::circleCircleIntersection(c1[i], r1[i], c2[i], r2[i], geometry::CCW, pos)) sink += pos.x;
+			}
+		});
+		results.push_back(r);
+	}
+
+	{
+		int num_gears = 0;
+		for (int i = 0; i < design.assemblies.size(); ++i) {
+			num_gears += design.assemblies[i]->gears.size();
+		}
+
+		BenchmarkResult r = result;
+		r.name = "Gear::getLinkEndPosition";
+		measure(r, num_gears, min_time, [&]() {
+			for (int i = 0; i < design.assemblies.size(); ++i) {
+				std::vector<Gear>& gears = design.assemblies[i]->gears;
+				for (int j = 0; j < gears.size(); ++j) {
+					sink += gears[j].getLinkEndPosition().x;
+				}
+			}
+		});
+		results.push_back(r);
+	}
+
+	{
+		BenchmarkResult r = result;
+		r.name = "MechanicalAssembly::getEndEffectorPosition";
+		measure(r, design.assemblies.size(), min_time, [&]() {
+			glm::vec2 pos;
+			for (int i = 0; i < design.assemblies.size(); ++i) {
+				// measure the solve rather than the cached state
+				design.assemblies[i]->invalidate();
+				if (design.assemblies[i]->getEndEffectorPosition(pos)) sink += pos.x;
+			}
+		});
+		results.push_back(r);
+	}
+
+	{
+		Kinematics kinematics;
+		makeSyntheticDesign(base, copies, kinematics);
+
+		BenchmarkResult r = result;
+		r.name = "MechanicalAssembly::forward";
+		measure(r, kinematics.assemblies.size(), min_time, [&]() {
+			for (int i = 0; i < kinematics.assemblies.size(); ++i) {
+				kinematics.assemblies[i]->forward(kinematics.time_step);
+			}
+			sink += kinematics.assemblies[0]->phase;
+		});
+		results.push_back(r);
+	}
+
+	{
+		BenchmarkResult r = result;
+		r.name = "Kinematics::forwardKinematics";
+		measure(r, 1, min_time, [&]() {
+			design.forwardKinematics();
+			sink += design.points.x[0];
+		});
+		results.push_back(r);
+	}
+
+	// the same solve in the other scalar modes
+	{
+		KinematicsSolver<double> solver(design);
+
+		BenchmarkResult r = result;
+		r.name = "KinematicsSolver<double>::forwardKinematics";
+		measure(r, 1, min_time, [&]() {
+			solver.forwardKinematics();
+			sink += solver.x[0];
+		});
+		results.push_back(r);
+	}
+
+	// one column of the Jacobian with respect to the parameters
+	{
+		KinematicsSolver<Dual<double>> solver(design);
+		seedParam(solver, 0);
+
+		BenchmarkResult r = result;
+		r.name = "KinematicsSolver<Dual<double>>::forwardKinematics";
+		measure(r, 1, min_time, [&]() {
+			solver.forwardKinematics();
+			sink += solver.x[0].d;
+		});
+		results.push_back(r);
+	}
+
+	// moving one slider of the phase control
+	{
+		BenchmarkResult r = result;
+		r.name = "Kinematics::forwardKinematicsIncremental (one assembly)";
+		measure(r, design.assemblies.empty() ? 0 : 1, min_time, [&]() {
+			design.markAssemblyDirty(0);
+			design.forwardKinematicsIncremental();
+			sink += design.points.x[0];
+		});
+		results.push_back(r);
+	}
+
+	{
+		Kinematics kinematics;
+		makeSyntheticDesign(base, copies, kinematics);
+
+		BenchmarkResult r = result;
+		r.name = "Kinematics::stepForward";
+		measure(r, 1, min_time, [&]() {
+			kinematics.stepForward();
+			sink += kinematics.points.x[0];
+		});
+		results.push_back(r);
+	}
+
+	// same as above, but every frame is solved
+	{
+		Kinematics kinematics;
+		makeSyntheticDesign(base, copies, kinematics);
+		kinematics.frame_cache.num_frames = 0;
+
+		BenchmarkResult r = result;
+		r.name = "Kinematics::stepForward (uncached)";
+		measure(r, 1, min_time, [&]() {
+			kinematics.stepForward();
+			sink += kinematics.points.x[0];
+		});
+		results.push_back(r);
+	}
+}
+
+/**
+ * Write the results as JSON, so that they can be compared from run to run.
+ */
+bool writeResultsJson(const QString& filename, double min_time, const std::vector<BenchmarkResult>& results) {
+	QJsonArray array;
+	for (int i = 0; i < results.size(); ++i) {
+		QJsonObject obj;
+		obj["design"] = results[i].design;
+		obj["copies"] = results[i].copies;
+		obj["points"] = results[i].num_points;
+		obj["benchmark"] = results[i].name;
+		if (results[i].error.isEmpty()) {
+			obj["iterations"] = (double)results[i].iterations;
+			obj["ns_per_op"] = results[i].ns_per_op;
+			obj["allocations_per_op"] = results[i].allocations_per_op;
+		}
+		else {
+			obj["error"] = results[i].error;
+		}
+		array.append(obj);
+	}
+
+	QJsonObject root;
+	root["date"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+	root["min_time_ms"] = min_time;
+	root["results"] = array;
+
+	QFile file(filename);
+	if (!file.open(QFile::WriteOnly)) return false;
+	file.write(QJsonDocument(root).toJson());
+	file.close();
+
+	return true;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <QString>
+#include <vector>
+#include "Kinematics.h"
+
+/**
+ * Measurement of one hot path on one design.
+ */
+class BenchmarkResult {
+public:
+	QString design;
+	int copies;
+	int num_points;
+	QString name;
+	long long iterations;
+	double ns_per_op;
+	double allocations_per_op;
+	QString error;
+
+public:
+	BenchmarkResult() : copies(0), num_points(0), iterations(0), ns_per_op(0), allocations_per_op(0) {}
+};
+
+void benchmarkHotPaths(const QString& design_name, const kinematics::Kinematics& base, int copies, double min_time, std::vector<BenchmarkResult>& results);
+bool writeResultsJson(const QString& filename, double min_time, const std::vector<BenchmarkResult>& results);
@@ -0,0 +1,67 @@
+#include "SyntheticDesign.h"
+#include <algorithm>
+
+using namespace kinematics;
+
+/**
+ * Make a large design by tiling copies of a base design on a square grid.
+ * Each copy is a rigid translation of the base, so the copies move independently
+ * and are as feasible as the base design.
+ */
+void makeSyntheticDesign(const Kinematics& base, int copies, Kinematics& design) {
+	design.points.clear();
+	design.links.clear();
+	design.assemblies.clear();
+	design.bodies.clear();
+	design.trace_end_effector.clear();
+
+	// size of a tile
+	glm::vec2 bbox_min(0, 0), bbox_max(0, 0);
+	int max_id = 0;
+	for (int i = 0; i < base.points.size(); ++i) {
+		if (i == 0) {
+			bbox_min = bbox_max = base.points.pos(i);
+		}
+		bbox_min = glm::min(bbox_min, base.points.pos(i));
+		bbox_max = glm::max(bbox_max, base.points.pos(i));
+		max_id = std::max(max_id, base.points.ids[i]);
+	}
+	glm::vec2 tile = bbox_max - bbox_min + glm::vec2(100, 100);
+	int cols = std::max(1, (int)ceil(sqrt((float)copies)));
+
+	int n = base.points.size();
+	for (int c = 0; c < copies; ++c) {
+		glm::vec2 offset((c % cols) * tile.x, (c / cols) * tile.y);
+
+		for (int i = 0; i < n; ++i) {
+			design.points.add(base.points.ids[i] + c * (max_id + 1), base.points.pos(i) + offset);
+		}
+
+		for (int i = 0; i < base.links.size(); ++i) {
+			const Link& link = base.links[i];
+			design.links.push_back(Link(link.start + c * n, link.end + c * n, link.order, link.length));
+		}
+
+		for (int i = 0; i < base.assemblies.size(); ++i) {
+			boost::shared_ptr<MechanicalAssembly> ass = boost::shared_ptr<MechanicalAssembly>(new MechanicalAssembly(*base.assemblies[i]));
+			ass->end_effector += c * n;
+			for (int j = 0; j < ass->gears.size(); ++j) {
+				ass->gears[j].center += offset;
+			}
+			ass->invalidate();
+			design.assemblies.push_back(ass);
+		}
+
+		for (int i = 0; i < base.bodies.size(); ++i) {
+			Part part(base.bodies[i].pivot1 + c * n, base.bodies[i].pivot2 + c * n);
+			part.points = base.bodies[i].points;
+			design.bodies.push_back(part);
+		}
+	}
+
+	design.trace_end_effector.resize(design.assemblies.size(), RingBuffer<glm::vec2>(240));
+
+	design.points.buildAdjacency(design.links);
+	design.compile();
+	design.invalidateFrameCache();
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "Kinematics.h"
+
+void makeSyntheticDesign(const kinematics::Kinematics& base, int copies, kinematics::Kinematics& design);
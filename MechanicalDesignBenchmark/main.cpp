@@ -0,0 +1,321 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QDir>
+#include <QImage>
+#include <QPainter>
+#include <iostream>
+#include <cstdio>
+#include "Kinematics.h"
+#include "OverlayPainter.h"
+#include "DomDesignIO.h"
+#include "SyntheticDesign.h"
+#include "HotPathBenchmark.h"
+#include "AllocationCounter.h"
+
+namespace {
+	// number of steps checked for the mechanisms that are not periodic
+	const int NON_PERIODIC_STEPS = 1000;
+
+	// number of frames between the feasibility levels rendered while the overlays are checked
+	const int LEVEL_INTERVAL = 8;
+}
+
+/**
+ * Checksum of the loaded state, to make sure that both loaders produce the same design.
+ */
+double checksum(const kinematics::Kinematics& kinematics) {
+	double sum = kinematics.links.size() + kinematics.assemblies.size() * 10 + kinematics.bodies.size() * 100 + kinematics.solve_schedule.size() * 1000;
+	for (int i = 0; i < kinematics.points.size(); ++i) {
+		sum += kinematics.points.x[i] * 1.1 + kinematics.points.y[i] * 0.9;
+	}
+	for (int i = 0; i < kinematics.bodies.size(); ++i) {
+		for (int j = 0; j < kinematics.bodies[i].points.size(); ++j) {
+			sum += kinematics.bodies[i].points[j].x * 0.7 + kinematics.bodies[i].points[j].y * 0.3;
+		}
+	}
+	return sum;
+}
+
+/**
+ * Return the best time of the repeated runs in milliseconds.
+ */
+template<typename F>
+double bestTime(int repeats, F func) {
+	double best = 0;
+	for (int r = 0; r < repeats; ++r) {
+		QElapsedTimer timer;
+		timer.start();
+		func();
+		double ms = timer.nsecsElapsed() * 1e-6;
+		if (r == 0 || ms < best) best = ms;
+	}
+	return best;
+}
+
+/**
+ * Compare the DOM-based design I/O with the streaming one on synthetic designs made
+ * of the given numbers of copies of the base design.
+ */
+bool benchmarkDesignIO(const QString& base_filename, const std::vector<int>& copies, int repeats, const QDir& work_dir) {
+	kinematics::Kinematics base;
+	try {
+		base.load(base_filename);
+	}
+	catch (const char* ex) {
+		std::cerr << base_filename.toUtf8().constData() << ": " << ex << std::endl;
+		return false;
+	}
+	catch (const QString& ex) {
+		std::cerr << base_filename.toUtf8().constData() << ": " << ex.toUtf8().constData() << std::endl;
+		return false;
+	}
+
+	printf("%s\n", QFileInfo(base_filename).fileName().toUtf8().constData());
+	printf("%8s %8s %10s %12s %12s %8s %12s %12s %8s\n", "copies", "points", "size [KB]", "DOM load", "stream load", "speedup", "DOM save", "stream save", "speedup");
+
+	bool ok = true;
+	for (int i = 0; i < copies.size(); ++i) {
+		kinematics::Kinematics design;
+		makeSyntheticDesign(base, copies[i], design);
+
+		QString filename = work_dir.filePath(QString("benchmark_%1.xml").arg(copies[i]));
+		QString dom_filename = work_dir.filePath(QString("benchmark_%1_dom.xml").arg(copies[i]));
+
+		double dom_save = bestTime(repeats, [&]() { saveDesignWithDom(design, dom_filename); });
+		double stream_save = bestTime(repeats, [&]() { design.save(filename); });
+
+		kinematics::Kinematics dom_loaded;
+		kinematics::Kinematics stream_loaded;
+		double dom_load = bestTime(repeats, [&]() { loadDesignWithDom(dom_loaded, filename); });
+		double stream_load = bestTime(repeats, [&]() { stream_loaded.load(filename); });
+
+		if (checksum(dom_loaded) != checksum(stream_loaded)) {
+			std::cerr << "The loaded designs differ for " << copies[i] << " copies." << std::endl;
+			ok = false;
+		}
+
+		printf("%8d %8d %10.1f %12.3f %12.3f %7.2fx %12.3f %12.3f %7.2fx\n", copies[i], design.points.size(), QFileInfo(filename).size() / 1024.0, dom_load, stream_load, dom_load / stream_load, dom_save, stream_save, dom_save / stream_save);
+
+		QFile::remove(filename);
+		QFile::remove(dom_filename);
+	}
+
+	return ok;
+}
+
+/**
+ * Measure the hot paths of the kinematics on synthetic designs made of the given
+ * numbers of copies of the base design, and append the results.
+ */
+bool runHotPathBenchmarks(const QString& base_filename, const std::vector<int>& copies, double min_time, std::vector<BenchmarkResult>& results) {
+	kinematics::Kinematics base;
+	try {
+		base.load(base_filename);
+	}
+	catch (const char* ex) {
+		std::cerr << base_filename.toUtf8().constData() << ": " << ex << std::endl;
+		return false;
+	}
+	catch (const QString& ex) {
+		std::cerr << base_filename.toUtf8().constData() << ": " << ex.toUtf8().constData() << std::endl;
+		return false;
+	}
+
+	QString design_name = QFileInfo(base_filename).fileName();
+	printf("%s\n", design_name.toUtf8().constData());
+	printf("%8s %8s  %-56s %12s %12s\n", "copies", "points", "benchmark", "ns/op", "allocs/op");
+
+	for (int i = 0; i < copies.size(); ++i) {
+		int first = results.size();
+		benchmarkHotPaths(design_name, base, copies[i], min_time, results);
+
+		for (int j = first; j < results.size(); ++j) {
+			const BenchmarkResult& result = results[j];
+			if (result.error.isEmpty()) {
+				printf("%8d %8d  %-56s %12.1f %12.2f\n", result.copies, result.num_points, result.name.toUtf8().constData(), result.ns_per_op, result.allocations_per_op);
+			}
+			else {
+				printf("%8d %8d  %-56s %s\n", result.copies, result.num_points, result.name.toUtf8().constData(), result.error.toUtf8().constData());
+			}
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Paint the overlays of the canvas over the mechanism: a feasibility level, which
+ * is rendered again every few frames as if a new one arrived, the traces as the
+ * previewed trajectories, and the highlight of an item of each type in turn, as
+ * when the mouse moves over the mechanism.
+ */
+void drawOverlays(QPainter& painter, OverlayPainter& overlay_painter, const kinematics::Kinematics& kinematics, const FeasibilityLevel& level, int step) {
+	// a level arrives every few frames while a gear is dragged, and is rendered into the cached image
+	if (step % LEVEL_INTERVAL == 0) overlay_painter.setFeasibility(level);
+	overlay_painter.drawFeasibility(painter);
+	overlay_painter.drawPreview(painter, kinematics.trace_end_effector);
+
+	kinematics::PickItem items[] = {
+		kinematics::PickItem(kinematics::PickItem::JOINT, 0),
+		kinematics::PickItem(kinematics::PickItem::LINK, 0),
+		kinematics::PickItem(kinematics::PickItem::GEAR, 0, 0),
+		kinematics::PickItem(kinematics::PickItem::BODY, 0)
+	};
+	const kinematics::PickItem& item = items[step % 4];
+	if (item.type == kinematics::PickItem::JOINT && kinematics.points.size() == 0) return;
+	if (item.type == kinematics::PickItem::LINK && kinematics.links.empty()) return;
+	if (item.type == kinematics::PickItem::GEAR && (kinematics.assemblies.empty() || kinematics.assemblies[0]->gears.empty())) return;
+	if (item.type == kinematics::PickItem::BODY && kinematics.bodies.empty()) return;
+	overlay_painter.drawHighlight(painter, kinematics, item);
+}
+
+/**
+ * Step and paint the design with the overlays of the canvas until the frames of a
+ * cycle are cached and the traces are full, and then count the heap allocations
+ * made by stepping and painting it for another cycle. The traces are faded, which
+ * is the painting path with the most pens. Returns false if the steady state
+ * allocates.
+ */
+bool checkSteadyStateAllocations(const QString& filename) {
+	kinematics::Kinematics kinematics;
+	try {
+		kinematics.load(filename);
+	}
+	catch (const char* ex) {
+		std::cerr << filename.toUtf8().constData() << ": " << ex << std::endl;
+		return false;
+	}
+	catch (const QString& ex) {
+		std::cerr << filename.toUtf8().constData() << ": " << ex.toUtf8().constData() << std::endl;
+		return false;
+	}
+	kinematics.fadeTraces(true);
+
+	int num_steps = kinematics.frame_cache.num_frames > 0 ? kinematics.frame_cache.num_frames : NON_PERIODIC_STEPS;
+	int num_warm_up_steps = num_steps * 2;
+	for (int i = 0; i < kinematics.trace_end_effector.size(); ++i) {
+		num_warm_up_steps = std::max(num_warm_up_steps, kinematics.trace_end_effector[i].capacity());
+	}
+
+	// a single painter is used, since beginning to paint allocates in Qt itself
+	QImage image(1024, 1024, QImage::Format_ARGB32_Premultiplied);
+	image.fill(Qt::white);
+	QPainter painter(&image);
+
+	// the finest level that the feasibility map publishes, around the first gear
+	OverlayPainter overlay_painter;
+	FeasibilityLevel level;
+	level.size = FeasibilityMap::COARSE_GRID_SIZE << FeasibilityMap::NUM_REFINEMENTS;
+	level.cell_size = (float)FeasibilityMap::COARSE_CELL_SIZE / (1 << FeasibilityMap::NUM_REFINEMENTS);
+	glm::vec2 center(512, 512);
+	if (!kinematics.assemblies.empty() && !kinematics.assemblies[0]->gears.empty()) center = kinematics.assemblies[0]->gears[0].center;
+	level.origin = center - glm::vec2(level.size, level.size) * (level.cell_size * 0.5f);
+	for (int i = 0; i < level.size * level.size; ++i) {
+		level.values.push_back((float)(i % 5) / 4);
+	}
+
+	for (int i = 0; i < num_warm_up_steps; ++i) {
+		kinematics.stepForward();
+		kinematics.draw(painter);
+		drawOverlays(painter, overlay_painter, kinematics, level, i);
+	}
+
+	long long step_allocations = 0;
+	long long paint_allocations = 0;
+	for (int i = 0; i < num_steps; ++i) {
+		long long count = allocationCount();
+		kinematics.stepForward();
+		step_allocations += allocationCount() - count;
+
+		count = allocationCount();
+		kinematics.draw(painter);
+		drawOverlays(painter, overlay_painter, kinematics, level, i);
+		paint_allocations += allocationCount() - count;
+	}
+	painter.end();
+
+	bool ok = step_allocations == 0 && paint_allocations == 0;
+	printf("%-32s %8d %12lld %12lld  %s\n", QFileInfo(filename).fileName().toUtf8().constData(), num_steps, step_allocations, paint_allocations, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+int main(int argc, char *argv[]) {
+	QCoreApplication a(argc, argv);
+	QCoreApplication::setApplicationName("MechanicalDesignBenchmark");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Benchmark the kinematics code on synthetic designs.");
+	parser.addHelpOption();
+	QCommandLineOption copies_option(QStringList() << "c" << "copies", "Comma-separated numbers of copies of the base design (default 1,10,100,1000).", "copies", "1,10,100,1000");
+	parser.addOption(copies_option);
+	QCommandLineOption repeats_option(QStringList() << "r" << "repeats", "Number of runs of which the best time is reported in the I/O benchmark (default 5).", "repeats", "5");
+	parser.addOption(repeats_option);
+	QCommandLineOption min_time_option(QStringList() << "t" << "min-time", "Minimum time in milliseconds to run each hot path (default 100).", "ms", "100");
+	parser.addOption(min_time_option);
+	QCommandLineOption output_option(QStringList() << "o" << "output", "JSON file to write the results of the hot paths to (default benchmark.json).", "file", "benchmark.json");
+	parser.addOption(output_option);
+	QCommandLineOption io_option("io", "Compare the DOM-based and the streaming design I/O instead of measuring the hot paths.");
+	parser.addOption(io_option);
+	QCommandLineOption check_allocations_option("check-allocations", "Check that stepping and painting the designs do not allocate once they are warmed up, and fail otherwise.");
+	parser.addOption(check_allocations_option);
+	parser.addPositionalArgument("designs", "Base design files (*.xml, *.mdb) or directories of them.", "designs...");
+	parser.process(a);
+
+	QStringList filenames;
+	QStringList args = parser.positionalArguments();
+	for (int i = 0; i < args.size(); ++i) {
+		QFileInfo info(args[i]);
+		if (info.isDir()) {
+			QFileInfoList entries = QDir(args[i]).entryInfoList(QStringList() << "*.xml" << "*.mdb", QDir::Files, QDir::Name);
+			for (int j = 0; j < entries.size(); ++j) {
+				filenames.push_back(entries[j].filePath());
+			}
+		}
+		else {
+			filenames.push_back(args[i]);
+		}
+	}
+	if (filenames.isEmpty()) parser.showHelp(1);
+
+	std::vector<int> copies;
+	QStringList list = parser.value(copies_option).split(",");
+	for (int i = 0; i < list.size(); ++i) {
+		bool ok = false;
+		int n = list[i].toInt(&ok);
+		if (!ok || n <= 0) {
+			std::cerr << "Invalid number of copies." << std::endl;
+			return 1;
+		}
+		copies.push_back(n);
+	}
+	int repeats = std::max(1, parser.value(repeats_option).toInt());
+	double min_time = std::max(1.0, parser.value(min_time_option).toDouble());
+
+	bool ok = true;
+	if (parser.isSet(check_allocations_option)) {
+		printf("%-32s %8s %12s %12s\n", "design", "steps", "step allocs", "paint allocs");
+		for (int i = 0; i < filenames.size(); ++i) {
+			if (!checkSteadyStateAllocations(filenames[i])) ok = false;
+		}
+	}
+	else if (parser.isSet(io_option)) {
+		for (int i = 0; i < filenames.size(); ++i) {
+			if (!benchmarkDesignIO(filenames[i], copies, repeats, QDir::temp())) ok = false;
+		}
+	}
+	else {
+		std::vector<BenchmarkResult> results;
+		for (int i = 0; i < filenames.size(); ++i) {
+			if (!runHotPathBenchmarks(filenames[i], copies, min_time, results)) ok = false;
+		}
+
+		if (!writeResultsJson(parser.value(output_option), min_time, results)) {
+			std::cerr << "Cannot write " << parser.value(output_option).toUtf8().constData() << std::endl;
+			ok = false;
+		}
+	}
+
+	return ok ? 0 : 1;
+}
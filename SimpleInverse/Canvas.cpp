@@ -1,4 +1,5 @@
 #include "Canvas.h"
+#include "Geometry.h"
 #include <QPainter>
 #include <iostream>
 #include <QFileInfoList>
@@ -17,22 +18,6 @@ double crossProduct(const glm::dvec2& v1, const glm::dvec2& v2) {
 	return v1.x * v2.y - v1.y * v2.x;
 }
 
-glm::dvec2 circleCircleIntersection(const glm::dvec2& center1, double radius1, const glm::dvec2& center2, double radius2) {
-	glm::dvec2 dir = center2 - center1;
-	double d = glm::length(dir);
-	if (d > radius1 + radius2 || d < abs(radius1 - radius2)) {
-		throw "No intersection";
-	}
-
-	double a = (radius1 * radius1 - radius2 * radius2 + d * d) / d / 2.0;
-	double h = sqrtf(radius1 * radius1 - a * a);
-
-	glm::dvec2 perp(dir.y, -dir.x);
-	perp /= glm::length(perp);
-
-	return center1 + dir * a / d + perp * h;
-}
-
 glm::dvec2 lineLineIntersection(const glm::dvec2& p1, const glm::dvec2& p2, const glm::dvec2& p3, const glm::dvec2& p4) {
 	glm::dvec2 u = p2 - p1;
 	glm::dvec2 v = p4 - p3;
@@ -63,7 +48,7 @@ glm::dvec2 lineLineIntersection(const glm::dvec2& p1, const glm::dvec2& p2, cons
 	return p1 + (p2 - p1) * t0;
 }
 
-Canvas::Canvas(QWidget *parent) : QWidget(parent) {
+Canvas::Canvas(QWidget *parent) : QWidget(parent), trace(1000) {
 	ctrlPressed = false;
 	shiftPressed = false;
 	theta = 0;
@@ -217,17 +202,22 @@ void Canvas::solveInverse(std::vector<std::vector<glm::dvec2>>& input_points, do
 	trace.clear();
 }
 
-void Canvas::forwardKinematics(double theta) {
-	if (points.size() == 0) return;
+/**
+ * Update the positions of the points at the given angle of the driving link.
+ * Returns false if the linkage cannot be assembled. The points are overwritten in
+ * place, so that stepping does not allocate.
+ */
+bool Canvas::forwardKinematics(double theta) {
+	if (points.size() == 0) return true;
 
 	// calculate the position of points that do not move
-	points.clear();
+	points.resize(std::max(idx_driving_point + 2, (int)lengths.size() + 1));
 	for (int i = 0; i <= idx_driving_point; ++i) {
-		points.push_back(input_points.back()[i]);
+		points[i] = input_points.back()[i];
 	}
 
 	// calcualte the position of the moving points
-	points.push_back(points[idx_driving_point] + glm::dvec2(cos(theta), sin(theta)) * lengths[idx_driving_point]);
+	points[idx_driving_point + 1] = points[idx_driving_point] + glm::dvec2(cos(theta), sin(theta)) * lengths[idx_driving_point];
 	for (int i = idx_driving_point + 1; i < lengths.size(); ++i) {
 		double theta = atan2(-10, -100);
 		if (i > 1) {
@@ -237,19 +227,21 @@ void Canvas::forwardKinematics(double theta) {
 		glm::dvec2 p1 = points[i - 1] + glm::dvec2(cos(theta), sin(theta)) * linkages[i - 1].lengths[0];
 		glm::dvec2 p2;
 		if (linkages[i - 1].side_of_circle_circle_intersection == Linkage::CIRCLE_CIRCLE_INTERSECTION_RIGHT) {
-			p2 = circleCircleIntersection(p1, abs(linkages[i - 1].lengths[2]), points[i], abs(linkages[i - 1].lengths[1]));
+			if (!geometry::circleCircleIntersection(p1, abs(linkages[i - 1].lengths[2]), points[i], abs(linkages[i - 1].lengths[1]), geometry::CW, p2)) return false;
 		}
 		else {
-			p2 = circleCircleIntersection(points[i], abs(linkages[i - 1].lengths[1]), p1, abs(linkages[i - 1].lengths[2]));
+			if (!geometry::circleCircleIntersection(points[i], abs(linkages[i - 1].lengths[1]), p1, abs(linkages[i - 1].lengths[2]), geometry::CW, p2)) return false;
 		}
-		linkages[i - 1].points.clear();
-		linkages[i - 1].points.push_back(p1);
-		linkages[i - 1].points.push_back(p2);
+		linkages[i - 1].points.resize(2);
+		linkages[i - 1].points[0] = p1;
+		linkages[i - 1].points[1] = p2;
 
 		glm::dvec2 v = (points[i] - p2) * (linkages[i - 1].lengths[1] >= 0 ? 1.0 : -1.0);
 		v = v / glm::length(v);
-		points.push_back(points[i] + v * lengths[i]);
+		points[i + 1] = points[i] + v * lengths[i];
 	}
+
+	return true;
 }
 
 void Canvas::stepForward(int step_size) {
@@ -259,17 +251,13 @@ void Canvas::stepForward(int step_size) {
 		speed = -speed;
 	}
 
-	try {
-		forwardKinematics(theta);
-	}
-	catch (char* ex) {
+	if (!forwardKinematics(theta)) {
 		theta -= speed * step_size;
 		forwardKinematics(theta);
 		speed = -speed;
 	}
 
 	trace.push_back(points.back());
-	if (trace.size() > 1000) trace.erase(trace.begin());
 
 	/*
 	double angle0 = atan2(points[1].y - points[0].y, points[1].x - points[0].x);
@@ -363,13 +351,12 @@ void Canvas::paintEvent(QPaintEvent *e) {
 			}
 		}
 
-		// draw trace
-		if (trace.size() > 0) {
-			painter.setPen(QPen(QColor(255, 0, 0), 2));
-			for (int i = 0; i < trace.size() - 1; ++i) {
-				painter.drawLine(trace[i].x, height() - trace[i].y, trace[i + 1].x, height() - trace[i + 1].y);
-			}
-		}
+		// draw trace (the y axis points upward)
+		painter.save();
+		painter.translate(0, height());
+		painter.scale(1, -1);
+		trace_painter.draw(painter, trace, QPen(QColor(255, 0, 0), 2));
+		painter.restore();
 
 		painter.setPen(QPen(QColor(0, 0, 0), 1));
 		QFont font = painter.font();
@@ -464,14 +451,12 @@ void Canvas::keyPressEvent(QKeyEvent* e) {
 			solveInverse(input_points, 20);
 
 			// use the kinematic simulation to check the validness
-			try {
-				for (double th = angle_range.first; th <= angle_range.second; th += 0.1) {
-					forwardKinematics(th);
+			for (double th = angle_range.first; th <= angle_range.second; th += 0.1) {
+				if (!forwardKinematics(th)) {
+					solveInverse(input_points, -20);
+					break;
 				}
 			}
-			catch (char* ex) {
-				solveInverse(input_points, -20);
-			}
 			forwardKinematics(theta);
 		}
 		update();
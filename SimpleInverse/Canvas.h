@@ -5,6 +5,8 @@
 #include <QKeyEvent>
 #include <glm/glm.hpp>
 #include <QTimer>
+#include "RingBuffer.h"
+#include "TracePainter.h"
 #include "Linkage.h"
 
 class Canvas : public QWidget {
@@ -23,7 +25,8 @@ public:
 	std::vector<Linkage> linkages;
 	double theta;
 	int idx_driving_point;
-	std::vector<glm::dvec2> trace;
+	RingBuffer<glm::dvec2> trace;
+	TracePainter trace_painter;
 	double speed;
 	std::pair<double, double> angle_range;
 
@@ -35,7 +38,7 @@ public:
 
 	void init();
 	void solveInverse(std::vector<std::vector<glm::dvec2>>& input_points, double l);
-	void forwardKinematics(double theta);
+	bool forwardKinematics(double theta);
 	void stepForward(int step_size);
 	void run();
 	void stop();